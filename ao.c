@@ -28,47 +28,27 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
 
 /*EPICS includes*/
 #include <epicsExport.h>
 #include <devSup.h>
 #include <dbAccess.h>
 #include <recSup.h>
+#include <callback.h>
 #include <aoRecord.h>
 
 /*Application includes*/
 #include "parse.h"
 #include "evg.h"
 
-/*Macros*/
-#define NUMBER_OF_IO	100
-
-/*Local variables*/
-static	io_t		io[NUMBER_OF_IO];
-static	uint32_t	ioCount;
-
 /*Function prototypes*/
-static	long	init		(int after);
 static	long	initRecord	(aoRecord *record);
 static 	long	ioRecord	(aoRecord *record);
-static	void*	thread		(void* arg);
+static	void	process		(void* arg);
+static	void	complete	(void* arg, long status);
 
 /*Function definitions*/
 
-/** 
- * @brief 	Initializes record count
- *
- * @return	0 on success, -1 on failure
- */
-static long
-init(int after)
-{
-	if (!after)
-		ioCount = 0;
-	return 0;
-}
-
 /** 
  * @brief 	Initializes the record
  *
@@ -85,34 +65,41 @@ static long
 initRecord(aoRecord *record)
 {
 	int32_t	status;
+	io_t*	private;
 
-	if (ioCount >= NUMBER_OF_IO)
+	if (record->out.type != INST_IO) 
 	{
-		printf("[evg][initRecord] Unable to initialize %s: Too many records\r\n", record->name);
+		printf("[evg][initRecord] Unable to initialize %s: Illegal io type\r\n", record->name);
 		return -1;
 	}
-	if (record->out.type != INST_IO) 
+
+	private	=	evg_allocate();
+	if (!private)
 	{
-		printf("[evg][initRecord] Unable to initialize %s: Illegal io type\r\n", record->name);
+		printf("[evg][initRecord] Unable to initialize %s: Unable to allocate memory\r\n", record->name);
 		return -1;
 	}
 
-	status				=	evg_parse(&io[ioCount], record->out.value.instio.string);
+	status	=	evg_parse(private, record->out.value.instio.string);
 	if (status < 0)
 	{
 		printf("[evg][initRecord] Unable to initialize %s: Could not parse parameters\r\n", record->name);
 		return -1;
 	}
 
-	io[ioCount].device	=	evg_open(io[ioCount].name);	
-	if (io[ioCount].device == NULL)
+	private->device	=	evg_open(private->name);	
+	if (private->device == NULL)
 	{
 		printf("[evg][initRecord] Unable to initalize %s: Could not open device\r\n", record->name);
 		return -1;
 	}
 
-	record->dpvt	=	&io[ioCount];
-	ioCount++;
+	private->request.function	=	process;
+	private->request.arg		=	record;
+	private->request.name		=	private->command;
+	private->request.complete	=	complete;
+
+	record->dpvt	=	private;
 
 	return 0;
 }
@@ -125,7 +112,7 @@ initRecord(aoRecord *record)
  * 	Checks record parameters.
  * 	Parses IO string
  * 	Sets record's private structure
- * 	Starts thread that performs asynchronous IO on the record
+ * 	Queues the request that performs asynchronous IO on the record
  *
  * @param	record	:	Pointer to record being initializes
  * @return	0 on success, -1 on failure
@@ -135,7 +122,6 @@ ioRecord(aoRecord *record)
 {
 	int32_t		status	=	0;
 	io_t*		private	=	(io_t*)record->dpvt;
-	pthread_t	handle;
 
 	if (!record)
 	{
@@ -157,13 +143,14 @@ ioRecord(aoRecord *record)
 	 * Start IO
 	 */
 
-	/*If this is the first pass then start IO thread, set PACT, and return*/
+	/*If this is the first pass then queue the request to the device worker, set PACT, and return*/
 	if(!record->pact)
 	{
-		status	=	pthread_create(&handle, NULL, thread, (void*)record);	
-		if (status)
+		private->status	=	0;
+		status	=	evg_queue(private->device, &private->request);
+		if (status < 0)
 		{
-			printf("[evg][ioRecord] Unable to perform IO on %s: Unable to create thread\r\n", record->name);
+			printf("[evg][ioRecord] Unable to perform IO on %s: Unable to queue request\r\n", record->name);
 			return -1;
 		}
 		record->pact = true;
@@ -187,43 +174,53 @@ ioRecord(aoRecord *record)
 /** 
  * @brief 	Performs asynchronousIO on the record
  *
+ * This function is called by the device worker thread.
  * This function attemps the following:
- * 	Detaches the thread
  * 	Performs the requested IO
- *	Processes the record to finalize IO
  *
- * @param	arg	:	Pointer to thread arguments
- * @return	0 on success, -1 on failure
+ * @param	arg	:	Pointer to the record
  */
-void*
-thread(void* arg)
+static void
+process(void* arg)
 {
 	int			status	=	0;
 	aoRecord*	record	=	(aoRecord*)arg;
 	io_t*		private	=	(io_t*)record->dpvt;
 
-	/*Detach thread*/
-	pthread_detach(pthread_self());
-
-	if (strcmp(private->command, "") == 0)
-		;
-	else
+	switch (private->code)
 	{
-		printf("[evg][thread] Unable to io %s: Do not know how to process \"%s\" requested by %s\r\n", record->name, private->command, record->name);
-		private->status	=	-1;
+		default:
+			printf("[evg][process] Unable to io %s: Do not know how to process \"%s\" requested by %s\r\n", record->name, private->command, record->name);
+			private->status	=	-1;
+			break;
 	}
 	if (status < 0)
 	{
-		printf("[evg][thread] Unable to io %s\r\n", record->name);
+		printf("[evg][process] Unable to io %s\r\n", record->name);
 		private->status	=	-1;
 	}
+}
 
-	/*Process record*/
-	dbScanLock((struct dbCommon*)record);
-	(record->rset->process)(record);
-	dbScanUnlock((struct dbCommon*)record);
+/** 
+ * @brief 	Completes asynchronous IO on the record
+ *
+ * This function is called by the device worker thread once the IO is carried out,
+ * together with the requests gathered with it.
+ *
+ * @param	arg		:	Pointer to the record
+ * @param	status	:	0 on success, -1 if the gathered IO failed
+ */
+static void
+complete(void* arg, long status)
+{
+	aoRecord*	record	=	(aoRecord*)arg;
+	io_t*		private	=	(io_t*)record->dpvt;
+
+	if (status < 0)
+		private->status	=	-1;
 
-	return NULL;
+	/*Process record*/
+	callbackRequestProcessCallback(&private->callback, priorityLow, record);
 }
 
 struct devsup {
@@ -238,7 +235,7 @@ struct devsup {
 {
     6,
     NULL,
-    init,
+    NULL,
     initRecord,
     NULL,
     ioRecord,
@@ -0,0 +1,258 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	array.c
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Implements the device support shared by the array records (aai, aao, waveform)
+ */
+
+/*Standard includes*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*EPICS includes*/
+#include <dbAccess.h>
+
+/*Application includes*/
+#include "array.h"
+#include "evg.h"
+
+/*Function prototypes*/
+static	bool	isRead		(command_t code);
+static	bool	isEvents	(command_t code);
+
+/*Function definitions*/
+
+/**
+ * @brief	Tells whether a command reads slots into the array
+ *
+ * @param	code	:	Command of the record
+ * @return	true for the get commands, false otherwise
+ */
+static bool
+isRead(command_t code)
+{
+	return code == COMMAND_GET_EVENTS || code == COMMAND_GET_TIMESTAMPS;
+}
+
+/**
+ * @brief	Tells whether a command transfers events rather than timestamps
+ *
+ * @param	code	:	Command of the record
+ * @return	true for the event commands, false otherwise
+ */
+static bool
+isEvents(command_t code)
+{
+	return code == COMMAND_GET_EVENTS || code == COMMAND_SET_EVENTS || code == COMMAND_STAGE_EVENTS;
+}
+
+/**
+ * @brief	Checks an array record against its command and allocates its buffer
+ *
+ * Called by initRecord of the array records once the parameters are parsed.
+ * This function attemps the following:
+ * 	Checks that the command is one the record type supports.
+ * 	Checks that the element type and count suit the command.
+ * 	Sets the address range, the whole sequence by default.
+ * 	Allocates the buffer the worker transfers, see evg_takeArray and evg_giveArray.
+ *
+ * @param	*io			:	Private structure of the record
+ * @param	*record		:	Name of the record
+ * @param	nelm		:	Number of elements of the array
+ * @param	ftvl		:	Element type of the array
+ * @param	directions	:	ARRAY_READ and/or ARRAY_WRITE, the transfers the record type supports
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_initArray(io_t *io, const char *record, uint32_t nelm, uint16_t ftvl, uint32_t directions)
+{
+	switch (io->code)
+	{
+		case COMMAND_GET_EVENTS:
+		case COMMAND_GET_TIMESTAMPS:
+			if (directions & ARRAY_READ)
+				break;
+			printf("[evg][initArray] Unable to initialize %s: \"%s\" reads the device, use an input record\r\n", record, io->command);
+			return -1;
+		case COMMAND_SET_EVENTS:
+		case COMMAND_SET_TIMESTAMPS:
+		case COMMAND_STAGE_EVENTS:
+		case COMMAND_STAGE_TIMESTAMPS:
+			if (directions & ARRAY_WRITE)
+				break;
+			printf("[evg][initArray] Unable to initialize %s: \"%s\" writes the device, use an output record\r\n", record, io->command);
+			return -1;
+		default:
+			printf("[evg][initArray] Unable to initialize %s: \"%s\" is not an array command\r\n", record, io->command);
+			return -1;
+	}
+
+	/*Events are stored as UCHAR, timestamps as ULONG ticks, or DOUBLE times in another unit*/
+	if (isEvents(io->code) && ftvl != DBF_UCHAR)
+	{
+		printf("[evg][initArray] Unable to initialize %s: FTVL must be UCHAR\r\n", record);
+		return -1;
+	}
+	if (!isEvents(io->code) && io->unit == TIME_TICKS && ftvl != DBF_ULONG)
+	{
+		printf("[evg][initArray] Unable to initialize %s: FTVL must be ULONG\r\n", record);
+		return -1;
+	}
+	if (!isEvents(io->code) && io->unit != TIME_TICKS && ftvl != DBF_DOUBLE)
+	{
+		printf("[evg][initArray] Unable to initialize %s: FTVL must be DOUBLE for times in ns or us\r\n", record);
+		return -1;
+	}
+	if (nelm > NUMBER_OF_ADDRESSES)
+	{
+		printf("[evg][initArray] Unable to initialize %s: NELM must not exceed %u\r\n", record, NUMBER_OF_ADDRESSES);
+		return -1;
+	}
+
+	/*The array covers the address range, the whole sequence by default*/
+	if (!io->count)
+		io->count	=	nelm;
+	if (io->count > nelm || io->address + io->count > NUMBER_OF_ADDRESSES)
+	{
+		printf("[evg][initArray] Unable to initialize %s: Address range does not fit NELM\r\n", record);
+		return -1;
+	}
+	if ((io->code == COMMAND_STAGE_EVENTS || io->code == COMMAND_STAGE_TIMESTAMPS) && io->address)
+	{
+		printf("[evg][initArray] Unable to initialize %s: Staged sequences start at address 0\r\n", record);
+		return -1;
+	}
+
+	/*The worker transfers a copy of the array, never the array of the record*/
+	io->buffer	=	calloc(nelm, dbValueSize(ftvl));
+	if (!io->buffer)
+	{
+		printf("[evg][initArray] Unable to initialize %s: Unable to allocate memory\r\n", record);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Copies the array of a record into its buffer before the request is queued
+ *
+ * Called by ioRecord on the first pass, while record support holds the record lock.
+ * Does nothing for commands that read the device.
+ *
+ * @param	*io		:	Private structure of the record
+ * @param	*array	:	Array of the record
+ * @param	count	:	Number of elements in the array
+ * @param	ftvl	:	Element type of the array
+ */
+void
+evg_takeArray(io_t *io, const void *array, uint32_t count, uint16_t ftvl)
+{
+	if (isRead(io->code))
+		return;
+
+	memcpy(io->buffer, array, count * dbValueSize(ftvl));
+	io->length	=	count;
+}
+
+/**
+ * @brief	Copies the buffer of a record into its array once the request is carried out
+ *
+ * Called by ioRecord on the second pass, while record support holds the record lock again.
+ * Does nothing for commands that write the device.
+ *
+ * @param	*io		:	Private structure of the record
+ * @param	*array	:	Array of the record
+ * @param	*count	:	Number of elements in the array, set to the number read
+ * @param	ftvl	:	Element type of the array
+ */
+void
+evg_giveArray(io_t *io, void *array, uint32_t *count, uint16_t ftvl)
+{
+	if (!isRead(io->code))
+		return;
+
+	memcpy(array, io->buffer, io->length * dbValueSize(ftvl));
+	*count	=	io->length;
+}
+
+/**
+ * @brief	Performs the IO of an array record
+ *
+ * Called by process of the array records in the device worker thread.
+ * Transfers the buffer in one pipelined transfer, see evg_readSlots and evg_applySlots,
+ * or stages it, see evg_stageSequence. Only touches the buffer, never the record.
+ *
+ * @param	*io		:	Private structure of the record
+ * @param	*record	:	Name of the record
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_processArray(io_t *io, const char *record)
+{
+	int32_t		status	=	0;
+	uint32_t	count	=	io->length < io->count ? io->length : io->count;
+
+	switch (io->code)
+	{
+		case COMMAND_GET_EVENTS:
+			status	=	evg_readSlots(io->device, io->sequencer, io->address, (uint8_t*)io->buffer, NULL, io->count);
+			io->length	=	io->count;
+			break;
+		case COMMAND_GET_TIMESTAMPS:
+			if (io->unit != TIME_TICKS)
+				status	=	evg_readSlotTimes(io->device, io->sequencer, io->address, NULL, (double*)io->buffer, io->unit, io->count);
+			else
+				status	=	evg_readSlots(io->device, io->sequencer, io->address, NULL, (uint32_t*)io->buffer, io->count);
+			io->length	=	io->count;
+			break;
+		case COMMAND_SET_EVENTS:
+			status	=	evg_applySlots(io->device, io->sequencer, io->address, (uint8_t*)io->buffer, NULL, count);
+			break;
+		case COMMAND_SET_TIMESTAMPS:
+			if (io->unit != TIME_TICKS)
+				status	=	evg_applySlotTimes(io->device, io->sequencer, io->address, NULL, (double*)io->buffer, io->unit, count);
+			else
+				status	=	evg_applySlots(io->device, io->sequencer, io->address, NULL, (uint32_t*)io->buffer, count);
+			break;
+		case COMMAND_STAGE_EVENTS:
+			status	=	evg_stageSequence(io->device, io->sequencer, (uint8_t*)io->buffer, NULL, io->length);
+			break;
+		case COMMAND_STAGE_TIMESTAMPS:
+			if (io->unit != TIME_TICKS)
+				status	=	evg_stageSequenceTimes(io->device, io->sequencer, NULL, (double*)io->buffer, io->unit, io->length);
+			else
+				status	=	evg_stageSequence(io->device, io->sequencer, NULL, (uint32_t*)io->buffer, io->length);
+			break;
+		default:
+			printf("[evg][processArray] Unable to io %s: Do not know how to process \"%s\"\r\n", record, io->command);
+			return -1;
+	}
+	if (status < 0)
+	{
+		printf("[evg][processArray] Unable to io %s\r\n", record);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	array.h
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Header file for the device support shared by the array records (aai, aao, waveform)
+ */
+
+#ifndef __ARRAY_H__
+#define __ARRAY_H__
+
+#include <stdint.h>
+
+#include "parse.h"
+
+/*Macros*/
+#define ARRAY_READ		1	/*The record reads slots into its array*/
+#define ARRAY_WRITE		2	/*The record writes or stages the slots of its array*/
+
+/*Function prototypes*/
+long	evg_initArray		(io_t *io, const char *record, uint32_t nelm, uint16_t ftvl, uint32_t directions);
+void	evg_takeArray		(io_t *io, const void *array, uint32_t count, uint16_t ftvl);
+void	evg_giveArray		(io_t *io, void *array, uint32_t *count, uint16_t ftvl);
+long	evg_processArray	(io_t *io, const char *record);
+
+#endif /*array.h*/
@@ -0,0 +1,280 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	benchmark.c
+ * @brief	Measures the transport of the driver against the EVG230 simulator
+ *
+ * Usage: evgBenchmark <dbd> [latency jitter [loss...]]
+ * Starts a simulator with the given latency and jitter in microseconds, brings a device up
+ * against it, then reports for each loss rate the register rate of single and batched writes,
+ * the time of a full sequence upload, and the p50/p99 latency of every evg_* call.
+ */
+
+/*Standard headers*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+/*EPICS headers*/
+#include <dbAccess.h>
+#include <dbStaticLib.h>
+#include <iocInit.h>
+#include <iocsh.h>
+
+/*Application headers*/
+#include "evg.h"
+#include "simulator.h"
+
+/*Macros*/
+#define BENCHMARK_PORT		50230	/*UDP port of the simulator*/
+#define BENCHMARK_SAMPLES	200		/*Number of calls timed per function*/
+#define BENCHMARK_WRITES	2000	/*Number of registers written to measure the register rate*/
+#define BENCHMARK_UPLOADS	5		/*Number of full sequence uploads timed*/
+#define BENCHMARK_LOSSES	8		/*Maximum number of loss rates*/
+
+/** @brief function_t is an evg_* call being timed, i is the number of the call */
+typedef struct
+{
+	const char	*name;
+	long		(*call)	(void *device, uint32_t i);
+} function_t;
+
+/*Function prototypes*/
+int					evgBenchmark_registerRecordDeviceDriver	(struct dbBase *pdbbase);
+static	void		run			(void *device, double loss);
+static	uint64_t	elapsed		(void);
+static	int			compare		(const void *a, const void *b);
+
+/*Calls being timed*/
+static	long	enable					(void *d, uint32_t i)	{ (void)i; return evg_enable(d, true); }
+static	long	isEnabled				(void *d, uint32_t i)	{ (void)i; return evg_isEnabled(d) < 0 ? -1 : 0; }
+static	long	setClock				(void *d, uint32_t i)	{ (void)i; return evg_setClock(d, USEC_DIVIDER); }
+static	long	getClock				(void *d, uint32_t i)	{ (void)i; uint16_t v; return evg_getClock(d, &v); }
+static	long	setRfClockSource		(void *d, uint32_t i)	{ (void)i; return evg_setRfClockSource(d, RF_SOURCE_INTERNAL); }
+static	long	getRfClockSource		(void *d, uint32_t i)	{ (void)i; rfsource_t v; return evg_getRfClockSource(d, &v); }
+static	long	setRfPrescaler			(void *d, uint32_t i)	{ return evg_setRfPrescaler(d, 1 + i % 31); }
+static	long	getRfPrescaler			(void *d, uint32_t i)	{ (void)i; uint8_t v; return evg_getRfPrescaler(d, &v); }
+static	long	setAcPrescaler			(void *d, uint32_t i)	{ return evg_setAcPrescaler(d, 1 + i % 200); }
+static	long	getAcPrescaler			(void *d, uint32_t i)	{ (void)i; uint8_t v; return evg_getAcPrescaler(d, &v); }
+static	long	setAcSyncSource			(void *d, uint32_t i)	{ return evg_setAcSyncSource(d, i & 1 ? AC_SOURCE_MXC7 : AC_SOURCE_EVENT); }
+static	long	getAcSyncSource			(void *d, uint32_t i)	{ (void)i; acsource_t v; return evg_getAcSyncSource(d, &v); }
+static	long	enableSequencer			(void *d, uint32_t i)	{ (void)i; return evg_enableSequencer(d, 0, true); }
+static	long	isSequencerEnabled		(void *d, uint32_t i)	{ (void)i; return evg_isSequencerEnabled(d, 0) < 0 ? -1 : 0; }
+static	long	setSequencerTrigger		(void *d, uint32_t i)	{ (void)i; return evg_setSequencerTriggerSource(d, 0, TRIGGER_SOFT); }
+static	long	getSequencerTrigger		(void *d, uint32_t i)	{ (void)i; triggersource_t v; return evg_getSequencerTriggerSource(d, 0, &v); }
+static	long	setSequencerPrescaler	(void *d, uint32_t i)	{ return evg_setSequencerPrescaler(d, 0, 1 + i % 1000); }
+static	long	getSequencerPrescaler	(void *d, uint32_t i)	{ (void)i; uint16_t v; return evg_getSequencerPrescaler(d, 0, &v); }
+static	long	triggerSequencer		(void *d, uint32_t i)	{ (void)i; return evg_triggerSequencer(d, 0); }
+static	long	setEvent				(void *d, uint32_t i)	{ return evg_setEvent(d, 0, i % NUMBER_OF_ADDRESSES, 1 + i % 100); }
+static	long	getEvent				(void *d, uint32_t i)	{ uint8_t v; return evg_getEvent(d, 0, i % NUMBER_OF_ADDRESSES, &v); }
+static	long	setTimestamp			(void *d, uint32_t i)	{ return evg_setTimestamp(d, 0, i % NUMBER_OF_ADDRESSES, i); }
+static	long	getTimestamp			(void *d, uint32_t i)	{ uint32_t v; return evg_getTimestamp(d, 0, i % NUMBER_OF_ADDRESSES, &v); }
+static	long	setSoftwareEvent		(void *d, uint32_t i)	{ return evg_setSoftwareEvent(d, 1 + i % 100); }
+static	long	setCounterPrescaler		(void *d, uint32_t i)	{ return evg_setCounterPrescaler(d, i % NUMBER_OF_COUNTERS, 1 + i); }
+static	long	getCounterPrescaler		(void *d, uint32_t i)	{ uint32_t v; return evg_getCounterPrescaler(d, i % NUMBER_OF_COUNTERS, &v); }
+static	long	setCounterPrescalers	(void *d, uint32_t i)	{ uint32_t v[NUMBER_OF_COUNTERS]; uint32_t c; for (c = 0; c < NUMBER_OF_COUNTERS; c++) v[c] = 1 + i + c; return evg_setCounterPrescalers(d, v); }
+static	long	getFirmwareVersion		(void *d, uint32_t i)	{ (void)i; uint16_t v; return evg_getFirmwareVersion(d, &v); }
+static	long	refresh					(void *d, uint32_t i)	{ (void)i; return evg_refresh(d); }
+static	long	verify					(void *d, uint32_t i)	{ (void)i; return evg_verify(d); }
+static	long	readSlots				(void *d, uint32_t i)	{ uint8_t e[16]; uint32_t t[16]; return evg_readSlots(d, 1, 16 * (i % 128), e, t, 16); }
+static	long	readSlotTimes			(void *d, uint32_t i)	{ uint8_t e[16]; double t[16]; return evg_readSlotTimes(d, 1, 16 * (i % 128), e, t, TIME_MICROSECONDS, 16); }
+
+static	const	function_t	functions[]	=
+{
+	{ "evg_enable",						enable },
+	{ "evg_isEnabled",					isEnabled },
+	{ "evg_setClock",					setClock },
+	{ "evg_getClock",					getClock },
+	{ "evg_setRfClockSource",			setRfClockSource },
+	{ "evg_getRfClockSource",			getRfClockSource },
+	{ "evg_setRfPrescaler",				setRfPrescaler },
+	{ "evg_getRfPrescaler",				getRfPrescaler },
+	{ "evg_setAcPrescaler",				setAcPrescaler },
+	{ "evg_getAcPrescaler",				getAcPrescaler },
+	{ "evg_setAcSyncSource",			setAcSyncSource },
+	{ "evg_getAcSyncSource",			getAcSyncSource },
+	{ "evg_enableSequencer",			enableSequencer },
+	{ "evg_isSequencerEnabled",			isSequencerEnabled },
+	{ "evg_setSequencerTriggerSource",	setSequencerTrigger },
+	{ "evg_getSequencerTriggerSource",	getSequencerTrigger },
+	{ "evg_setSequencerPrescaler",		setSequencerPrescaler },
+	{ "evg_getSequencerPrescaler",		getSequencerPrescaler },
+	{ "evg_triggerSequencer",			triggerSequencer },
+	{ "evg_setEvent",					setEvent },
+	{ "evg_getEvent",					getEvent },
+	{ "evg_setTimestamp",				setTimestamp },
+	{ "evg_getTimestamp",				getTimestamp },
+	{ "evg_setSoftwareEvent",			setSoftwareEvent },
+	{ "evg_setCounterPrescaler",		setCounterPrescaler },
+	{ "evg_getCounterPrescaler",		getCounterPrescaler },
+	{ "evg_setCounterPrescalers",		setCounterPrescalers },
+	{ "evg_getFirmwareVersion",			getFirmwareVersion },
+	{ "evg_refresh",					refresh },
+	{ "evg_verify",						verify },
+	{ "evg_readSlots",					readSlots },
+	{ "evg_readSlotTimes",				readSlotTimes },
+};
+
+int
+main(int argc, char **argv)
+{
+	uint32_t	i;
+	uint32_t	latency	=	argc > 3 ? atoi(argv[2]) : 0;
+	uint32_t	jitter	=	argc > 3 ? atoi(argv[3]) : 0;
+	uint32_t	count	=	0;
+	double		losses[BENCHMARK_LOSSES]	=	{ 0, 0.001, 0.01, 0.05 };
+	char		command[128];
+	void		*device;
+
+	if (argc < 2)
+	{
+		printf("Usage: %s <dbd> [latency jitter [loss...]]\n", argv[0]);
+		return 1;
+	}
+	for (i = 4; i < (uint32_t)argc && count < BENCHMARK_LOSSES; i++)
+		losses[count++]	=	atof(argv[i]);
+	if (!count)
+		count	=	4;
+
+	/*Bring a device up against a lossless simulator*/
+	if (evg_simulate(BENCHMARK_PORT, latency, jitter, 0) < 0)
+		return 1;
+	if (dbLoadDatabase(argv[1], NULL, NULL) || evgBenchmark_registerRecordDeviceDriver(pdbbase))
+	{
+		printf("Unable to load %s\n", argv[1]);
+		return 1;
+	}
+	sprintf(command, "evgConfigure evg0 127.0.0.1 %u %u", BENCHMARK_PORT, USEC_DIVIDER);
+	iocshCmd(command);
+	if (iocInit())
+		return 1;
+	device	=	evg_open("evg0");
+	if (!device)
+		return 1;
+
+	printf("latency %u us, jitter %u us\n", latency, jitter);
+	for (i = 0; i < count; i++)
+	{
+		evg_simulate(BENCHMARK_PORT, latency, jitter, losses[i]);
+		run(device, losses[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Measures the device at one loss rate and prints the report
+ *
+ * @param	*device	:	A pointer to the device
+ * @param	loss	:	Loss rate of the simulator
+ */
+static void
+run(void *device, double loss)
+{
+	uint32_t	i;
+	uint32_t	j;
+	uint32_t	failures;
+	uint64_t	start;
+	uint64_t	single;
+	uint64_t	batched;
+	uint64_t	upload;
+	uint64_t	samples[BENCHMARK_SAMPLES];
+	uint8_t		events[NUMBER_OF_ADDRESSES];
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];
+
+	/*Single register writes, one call each*/
+	failures	=	0;
+	start		=	elapsed();
+	for (i = 0; i < BENCHMARK_WRITES; i++)
+		failures	+=	evg_setAcPrescaler(device, 1 + i % 200) < 0;
+	single		=	elapsed() - start;
+
+	/*Batched register writes*/
+	start	=	elapsed();
+	for (i = 0; i < BENCHMARK_WRITES; i += j)
+	{
+		evg_batchBegin(device);
+		for (j = 0; j < 64 && i + j < BENCHMARK_WRITES; j++)
+			evg_batchWrite(device, REGISTER_AC_ENABLE, 1 + (i + j) % 200);
+		failures	+=	evg_batchCommit(device) < 0;
+	}
+	batched	=	elapsed() - start;
+
+	/*Full sequence uploads, a different table each time so that none is skipped*/
+	upload	=	0;
+	for (i = 0; i < BENCHMARK_UPLOADS; i++)
+	{
+		for (j = 0; j < NUMBER_OF_ADDRESSES; j++)
+		{
+			events[j]		=	j == NUMBER_OF_ADDRESSES - 1 ? EVENT_END_SEQUENCE : 1 + (i + j) % 100;
+			timestamps[j]	=	j * 8 + i;
+		}
+		start		=	elapsed();
+		failures	+=	evg_loadSequence(device, 1, events, timestamps, NUMBER_OF_ADDRESSES) < 0;
+		upload		+=	elapsed() - start;
+	}
+
+	printf("loss %.1f%%: %.0f registers/s single, %.0f registers/s batched, full sequence upload %.1f ms\n",
+		loss * 100, BENCHMARK_WRITES * 1e6 / single, BENCHMARK_WRITES * 1e6 / batched, upload / 1e3 / BENCHMARK_UPLOADS);
+
+	/*Latency of every call*/
+	for (i = 0; i < sizeof(functions) / sizeof(functions[0]); i++)
+	{
+		for (j = 0; j < BENCHMARK_SAMPLES; j++)
+		{
+			start		=	elapsed();
+			failures	+=	functions[i].call(device, j) < 0;
+			samples[j]	=	elapsed() - start;
+		}
+		qsort(samples, BENCHMARK_SAMPLES, sizeof(samples[0]), compare);
+		printf("\t%-32s p50 %8llu us\tp99 %8llu us\n", functions[i].name,
+			(unsigned long long)samples[BENCHMARK_SAMPLES / 2], (unsigned long long)samples[BENCHMARK_SAMPLES * 99 / 100]);
+	}
+	if (failures)
+		printf("\t%u calls failed\n", failures);
+}
+
+/**
+ * @brief	Reads the monotonic clock
+ *
+ * @return	Time in microseconds
+ */
+static uint64_t
+elapsed(void)
+{
+	struct timespec	time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+/**
+ * @brief	Orders two samples for qsort
+ */
+static int
+compare(const void *a, const void *b)
+{
+	uint64_t	x	=	*(const uint64_t*)a;
+	uint64_t	y	=	*(const uint64_t*)b;
+
+	return x < y ? -1 : x > y;
+}
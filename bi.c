@@ -28,7 +28,6 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
 
 /*EPICS includes*/
 #include <epicsExport.h>
@@ -36,40 +35,22 @@
 #include <errlog.h>
 #include <dbAccess.h>
 #include <recSup.h>
+#include <callback.h>
 #include <biRecord.h>
 
 /*Application includes*/
 #include "parse.h"
 #include "evg.h"
 
-/*Macros*/
-#define NUMBER_OF_IO	100
-
-/*Local variables*/
-static	io_t		io[NUMBER_OF_IO];
-static	uint32_t	ioCount;
-
 /*Function prototypes*/
-static	long	init		(int after);
 static	long	initRecord	(biRecord *record);
 static 	long	ioRecord	(biRecord *record);
-static	void*	thread		(void* arg);
+static	void	process		(void* arg);
+static	void	complete	(void* arg, long status);
+static	long	ioScan		(int command, biRecord *record, IOSCANPVT *scan);
 
 /*Function definitions*/
 
-/** 
- * @brief 	Initializes record count
- *
- * @return	0 on success, -1 on failure
- */
-static long
-init(int after)
-{
-	if (!after)
-		ioCount = 0;
-	return 0;
-}
-
 /** 
  * @brief 	Initializes the record
  *
@@ -86,34 +67,41 @@ static long
 initRecord(biRecord *record)
 {
 	int32_t	status;
+	io_t*	private;
 
-	if (ioCount >= NUMBER_OF_IO)
+	if (record->inp.type != INST_IO) 
 	{
-		printf("[evg][initRecord] Unable to initialize %s: Too many records\r\n", record->name);
+		printf("[evg][initRecord] Unable to initialize %s: Illegal io type\r\n", record->name);
 		return -1;
 	}
-	if (record->inp.type != INST_IO) 
+
+	private	=	evg_allocate();
+	if (!private)
 	{
-		printf("[evg][initRecord] Unable to initialize %s: Illegal io type\r\n", record->name);
+		printf("[evg][initRecord] Unable to initialize %s: Unable to allocate memory\r\n", record->name);
 		return -1;
 	}
 
-	status			=	evg_parse(&io[ioCount], record->inp.value.instio.string);
+	status	=	evg_parse(private, record->inp.value.instio.string);
 	if (status < 0)
 	{
 		printf("[evg][initRecord] Unable to initialize %s: Could not parse parameters\r\n", record->name);
 		return -1;
 	}
 
-	io[ioCount].device	=	evg_open(io[ioCount].name);	
-	if (io[ioCount].device == NULL)
+	private->device	=	evg_open(private->name);	
+	if (private->device == NULL)
 	{
 		printf("[evg][initRecord] Unable to initalize %s: Could not open device\r\n", record->name);
 		return -1;
 	}
 
-	record->dpvt	=	&io[ioCount];
-	ioCount++;
+	private->request.function	=	process;
+	private->request.arg		=	record;
+	private->request.name		=	private->command;
+	private->request.complete	=	complete;
+
+	record->dpvt	=	private;
 
 	return 0;
 }
@@ -134,7 +122,6 @@ ioRecord(biRecord *record)
 {
 	int32_t		status	=	0;
 	io_t*		private	=	(io_t*)record->dpvt;
-	pthread_t	handle;
 
 	if (!record)
 	{
@@ -156,13 +143,14 @@ ioRecord(biRecord *record)
 	 * Start IO
 	 */
 
-	/*If this is the first pass then start IO thread, set PACT, and return*/
+	/*If this is the first pass then queue the request to the device worker, set PACT, and return*/
 	if(!record->pact)
 	{
-		status	=	pthread_create(&handle, NULL, thread, (void*)record);	
-		if (status)
+		private->status	=	0;
+		status	=	evg_queue(private->device, &private->request);
+		if (status < 0)
 		{
-			printf("[evg][ioRecord] Unable to perform IO on %s: Unable to create thread\r\n", record->name);
+			printf("[evg][ioRecord] Unable to perform IO on %s: Unable to queue request\r\n", record->name);
 			return -1;
 		}
 		record->pact = true;
@@ -186,47 +174,91 @@ ioRecord(biRecord *record)
 /** 
  * @brief 	Performs asynchronousIO on the record
  *
+ * This function is called by the device worker thread.
  * This function attemps the following:
- * 	Detaches the thread
  * 	Performs the requested IO
- *	Processes the record to finalize IO
  *
- * @param	arg	:	Pointer to thread arguments
- * @return	0 on success, -1 on failure
+ * @param	arg	:	Pointer to the record
  */
-void*
-thread(void* arg)
+static void
+process(void* arg)
 {
 	int			status	=	0;
 	biRecord*	record	=	(biRecord*)arg;
 	io_t*		private	=	(io_t*)record->dpvt;
 
-	/*Detach thread*/
-	pthread_detach(pthread_self());
-
-	if (strcmp(private->command, "isEnabled") == 0)
-		status	=	evg_isEnabled(private->device);
-	else if (strcmp(private->command, "isSequencerEnabled") == 0)
-		status	=	evg_isSequencerEnabled(private->device, private->sequencer);
-	else
+	switch (private->code)
 	{
-		printf("[evg][thread] Unable to io %s: Do not know how to process \"%s\" requested by %s\r\n", record->name, private->command, record->name);
-		private->status	=	-1;
+		case COMMAND_IS_ENABLED:
+			status	=	evg_isEnabled(private->device);
+			break;
+		case COMMAND_IS_SEQUENCER_ENABLED:
+			status	=	evg_isSequencerEnabled(private->device, private->sequencer);
+			break;
+		default:
+			printf("[evg][process] Unable to io %s: Do not know how to process \"%s\" requested by %s\r\n", record->name, private->command, record->name);
+			private->status	=	-1;
+			break;
 	}
 	if (status < 0)
 	{
-		printf("[evg][thread] Unable to io %s\r\n", record->name);
+		printf("[evg][process] Unable to io %s\r\n", record->name);
 		private->status	=	-1;
 	}
 	else
 		record->rval	=	status;
+}
+
+/** 
+ * @brief 	Completes asynchronous IO on the record
+ *
+ * This function is called by the device worker thread once the IO is carried out,
+ * together with the requests gathered with it.
+ *
+ * @param	arg		:	Pointer to the record
+ * @param	status	:	0 on success, -1 if the gathered IO failed
+ */
+static void
+complete(void* arg, long status)
+{
+	biRecord*	record	=	(biRecord*)arg;
+	io_t*		private	=	(io_t*)record->dpvt;
+
+	if (status < 0)
+		private->status	=	-1;
 
 	/*Process record*/
-	dbScanLock((struct dbCommon*)record);
-	(record->rset->process)(record);
-	dbScanUnlock((struct dbCommon*)record);
+	callbackRequestProcessCallback(&private->callback, priorityLow, record);
+}
+
+/** 
+ * @brief 	Provides the I/O Intr scan list of the record
+ *
+ * This function is called by the IOC when the record is added to or removed from I/O Intr scanning.
+ * The scan list is posted by the device poller when the registers read by the record change.
+ *
+ * @param	command	:	0 when the record is added, 1 when it is removed
+ * @param	record	:	Pointer to the record
+ * @param	scan	:	Scan list of the record
+ * @return	0 on success, -1 on failure
+ */
+static long
+ioScan(int command, biRecord *record, IOSCANPVT *scan)
+{
+	io_t*		private	=	(io_t*)record->dpvt;
 
-	return NULL;
+	if (!private)
+	{
+		printf("[evg][ioScan] Unable to scan %s: Null private structure pointer\r\n", record->name);
+		return -1;
+	}
+	if (evg_getIoScan(private->device, private->command, private->sequencer, scan) < 0)
+	{
+		printf("[evg][ioScan] Unable to scan %s: Command does not support I/O Intr\r\n", record->name);
+		return -1;
+	}
+
+	return 0;
 }
 
 struct devsup {
@@ -240,9 +272,9 @@ struct devsup {
 {
     5,
     NULL,
-    init,
-    initRecord,
     NULL,
+    initRecord,
+    ioScan,
     ioRecord,
 };
 epicsExportAddress(dset, bievg);
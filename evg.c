@@ -30,8 +30,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#include <math.h>
 #include <pthread.h>
+#include <sched.h>
 #include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -42,57 +45,539 @@
 #include <drvSup.h>
 #include <errlog.h>
 #include <iocsh.h>
+#include <dbScan.h>
 
 /*Application headers*/
 #include "evg.h"
+#include "sequence.h"
+#include "simulator.h"
 
 /*
  * Macros
  */
 
-/** @brief device_t is a structure that holds configured device information */
+#define DEVICE_BUCKETS		64		/*Number of buckets of the device name hash table, a power of two*/
+#define NUMBER_OF_RETRIES	3		/*Maximum number of retransmissions*/
+#define WINDOW_SIZE			16		/*Maximum number of requests in flight per device*/
+#define GROUP_LENGTH		8		/*Maximum number of accesses in a chained group*/
+#define REGISTER_COUNT		64		/*Number of 16-bit registers in the register map*/
+#define TIMEOUT				1000	/*Reply timeout in milliseconds, until the round-trip time is measured*/
+#define RTO_FLOOR			5		/*Default lower bound of the retransmission timeout in milliseconds*/
+#define RTO_CEILING			TIMEOUT	/*Default upper bound of the retransmission timeout in milliseconds*/
+#define RTO_GRANULARITY		100		/*Smallest variance margin of the retransmission timeout in microseconds*/
+#define MESSAGE_BUFFER		64		/*Maximum number of messages read from one datagram*/
+#define BATCH_RECORDS		32		/*Maximum number of messages packed in one datagram*/
+#define BATCH_LENGTH		64		/*Maximum number of accesses in a batch*/
+#define QUEUE_LENGTH		1024	/*Maximum number of requests queued to a device worker*/
+#define SHADOW_PERIOD		10		/*Period of the shadow register resync in seconds*/
+#define SLOT_FIELDS			3		/*16-bit words of a sequencer slot: code, high and low timestamp*/
+#define COUNTER_WORDS		2		/*16-bit words of a counter prescaler*/
+#define HISTOGRAM_BINS		24		/*Number of power-of-two microsecond bins of a latency histogram*/
+#define STATS_COMMANDS		48		/*Maximum number of distinct commands counted per device*/
+#define POLL_PERIOD			1000	/*Default period of the I/O Intr poller in milliseconds*/
+#define NUMBER_OF_SCANS		32		/*Maximum number of distinct I/O Intr scan lists per device*/
+#define STARTUP_DEADLINE	5000	/*Default time iocInit waits for the devices to start in milliseconds*/
+#define RESTART_PERIOD		5		/*Period of the start attempts of offline devices in seconds*/
+#define AUDIT_SLOTS			64		/*Number of sequencer slots read back per audit step*/
+#define GATHER_REQUESTS		64		/*Maximum number of requests carried out together*/
+#define GATHER_LENGTH		128		/*Maximum number of gathered accesses*/
+#define LANE_LENGTH			32		/*Maximum number of priority writes waiting for their acknowledgement*/
+#define HEARTBEAT_PERIOD	1000	/*Default period of the heartbeat in milliseconds*/
+#define COMMIT_DRAIN		20000	/*Time given to a running sequence of unknown length to end, in microseconds*/
+#define COMMIT_DRAIN_LIMIT	1000000	/*Longest time waited for a running sequence to end, in microseconds*/
+#define ALL_SEQUENCERS		((1 << NUMBER_OF_SEQUENCERS) - 1)	/*Bitmask of every sequencer*/
+#define PEEK_ATTEMPTS		64		/*Attempts at reading the shadow copy without the mutex before taking it*/
+
+/*Bit of a register in register bitmasks*/
+#define REGISTER_BIT(reg)	(1ULL << (((reg) >> 1) % REGISTER_COUNT))
+/*Registers only changed by the IOC, served from the shadow copy*/
+#define SHADOW_REGISTERS	(REGISTER_BIT(REGISTER_CONTROL) | REGISTER_BIT(REGISTER_EVENT_ENABLE) | REGISTER_BIT(REGISTER_SEQ_CLOCK_SEL1) | \
+							 REGISTER_BIT(REGISTER_SEQ_CLOCK_SEL2) | REGISTER_BIT(REGISTER_AC_ENABLE) | REGISTER_BIT(REGISTER_MXC_CONTROL) | \
+							 REGISTER_BIT(REGISTER_FIRMWARE) | REGISTER_BIT(REGISTER_RF_CONTROL) | REGISTER_BIT(REGISTER_USEC_DIVIDER) | \
+							 REGISTER_BIT(REGISTER_SEQ_ADDRESS0) | REGISTER_BIT(REGISTER_SEQ_ADDRESS1))
+/*Registers whose target is selected by another register, verified on the spot*/
+#define INDEXED_REGISTERS	(REGISTER_BIT(REGISTER_MXC_PRESCALER) | REGISTER_BIT(REGISTER_SEQ_CODE0) | REGISTER_BIT(REGISTER_SEQ_TIME0) | \
+							 REGISTER_BIT(REGISTER_SEQ_TIME0+2) | REGISTER_BIT(REGISTER_SEQ_CODE1) | REGISTER_BIT(REGISTER_SEQ_TIME1) | \
+							 REGISTER_BIT(REGISTER_SEQ_TIME1+2))
+/*Registers that select the target of indexed registers, never gathered*/
+#define SELECTOR_REGISTERS	(REGISTER_BIT(REGISTER_MXC_CONTROL) | REGISTER_BIT(REGISTER_SEQ_ADDRESS0) | REGISTER_BIT(REGISTER_SEQ_ADDRESS1))
+/*Bits of the control register that clear themselves*/
+#define SHADOW_CONTROL_VOLATILE	(CONTROL_VTRG1 | CONTROL_VTRG2)
+
+/**
+ * @brief access_t describes a single register access carried out by the transport
+ *
+ * An access is chained when it operates on a target selected by the access preceding it,
+ * e.g. the sequencer RAM selected through REGISTER_SEQ_ADDRESS0. The first access of a chain
+ * (the head) and its chained accesses form a group that the transport delivers in order.
+ */
+typedef struct
+{
+	uint8_t		access;		/*ACCESS_READ or ACCESS_WRITE*/
+	bool		chained;	/*Depends on the target selected by the preceding access*/
+	uint16_t	reg;		/*Register address*/
+	uint16_t	data;		/*Data to be written, or data read*/
+} access_t;
+
+/** @brief batch_t collects register accesses to be carried out in one transfer */
+typedef struct
+{
+	uint32_t	count;						/*Number of accesses*/
+	bool		overflow;					/*Too many accesses were added*/
+	access_t	accesses[BATCH_LENGTH];		/*Accesses*/
+	uint16_t	*results[BATCH_LENGTH];		/*Destinations of read data*/
+} batch_t;
+
+/** @brief sequencerregs_t describes the registers and control bits of a sequencer, see sequencerRegisters */
+typedef struct
+{
+	evgregister_t	slot[SLOT_FIELDS + 1];	/*Address register, then the code, high and low timestamp words of the slot it selects*/
+	evgregister_t	clock;					/*Clock select register, i.e. prescaler*/
+	uint16_t		enable;					/*Bit of the event enable register*/
+	uint16_t		ac;						/*Bit of the AC enable register*/
+	uint16_t		trigger;				/*Software trigger bit of the control register*/
+} sequencerregs_t;
+
+/** @brief slottable_t is a table of slots to be written to the sequencer RAM, see uploadTables */
+typedef struct
+{
+	uint8_t			sequencer;		/*Sequencer to be written*/
+	uint16_t		first;			/*First address to write, the tables start with it*/
+	const uint8_t	*events;		/*Event codes, one per address, or NULL*/
+	const uint32_t	*timestamps;	/*Timestamps, one per address, or NULL*/
+	uint16_t		count;			/*Number of addresses to write*/
+} slottable_t;
+
+/** @brief staging_t holds a sequence staged for a later commit */
+typedef struct
+{
+	uint8_t		events[NUMBER_OF_ADDRESSES];		/*Staged event codes*/
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];	/*Staged timestamps*/
+	uint16_t	eventCount;							/*Number of staged event codes, 0 if none*/
+	uint16_t	timestampCount;						/*Number of staged timestamps, 0 if none*/
+	double		times[NUMBER_OF_ADDRESSES];			/*Staged times, converted when the device is started*/
+	timeunit_t	unit;								/*Unit of the staged times, TIME_TICKS once in the timestamps*/
+	bool		committing;							/*Table is being committed, set under the lane mutex too*/
+	uint64_t	triggered;							/*Time of the last software trigger of the sequencer, 0 if none*/
+} staging_t;
+
+/** @brief sequence_t is a named sequence of the library of a device */
+typedef struct sequence
+{
+	char			name[NAME_LENGTH];				/*Name of the sequence*/
+	uint8_t			events[NUMBER_OF_ADDRESSES];	/*Event codes, validated*/
+	double			times[NUMBER_OF_ADDRESSES];		/*Times, validated and converted to ticks when selected*/
+	timeunit_t		unit;							/*Unit of the times*/
+	uint16_t		count;							/*Number of slots*/
+	struct sequence	*next;							/*Next sequence of the library*/
+} sequence_t;
+
+/** @brief histogram_t is a latency histogram, bin i counts samples of 2^i to 2^(i+1)-1 microseconds */
+typedef struct
+{
+	uint64_t	count;					/*Number of samples*/
+	uint64_t	sum;					/*Sum of samples in microseconds*/
+	uint64_t	max;					/*Largest sample in microseconds*/
+	uint64_t	bins[HISTOGRAM_BINS];	/*Number of samples per bin*/
+} histogram_t;
+
+/** @brief stats_t holds the instrumentation of a device */
+typedef struct
+{
+	uint64_t	transfers;			/*Number of transfers*/
+	uint64_t	failures;			/*Number of failed transfers*/
+	uint64_t	accesses;			/*Number of register accesses requested*/
+	uint64_t	messages;			/*Number of messages sent, including retransmissions*/
+	uint64_t	datagrams;			/*Number of datagrams sent*/
+	uint64_t	retries;			/*Number of messages retransmitted*/
+	uint64_t	timeouts;			/*Number of messages that were not answered in time*/
+	uint64_t	replies;			/*Number of replies matched to a request*/
+	uint64_t	stale;				/*Number of replies that matched no request*/
+	uint64_t	shortReads;			/*Number of datagrams received with a truncated message*/
+	uint64_t	coalesced;			/*Number of register reads served by a read carried out for another requester*/
+	uint64_t	lockless;			/*Number of register reads served from the shadow copy without the mutex*/
+	uint64_t	auditedSlots;		/*Number of sequencer slots read back by deferred verification and audit*/
+	uint64_t	slotMismatches;		/*Number of sequencer words found to differ from the image*/
+	uint64_t	groups;				/*Number of groups of requests carried out together*/
+	uint64_t	gathered;			/*Number of writes gathered into the transfer of a group*/
+	uint64_t	resets;				/*Number of device resets detected by the heartbeat*/
+	histogram_t	rtt;				/*Round-trip time of answered messages*/
+	histogram_t	wait;				/*Time spent waiting for the device mutex*/
+	const char	*commands[STATS_COMMANDS];	/*Names of the commands requested*/
+	uint64_t	requests[STATS_COMMANDS];	/*Number of requests per command*/
+	uint32_t	commandCount;		/*Number of distinct commands requested*/
+} stats_t;
+
+/** @brief urgent_t is a write of the priority lane waiting for its acknowledgement */
+typedef struct
+{
+	uint16_t	reg;		/*Register address*/
+	uint16_t	data;		/*Data written*/
+	uint32_t	reference;	/*Request tag*/
+	uint64_t	time;		/*Time of the transmission*/
+} urgent_t;
+
+/** @brief lanestats_t holds the instrumentation of the priority lane of a device */
+typedef struct
+{
+	uint64_t	writes;			/*Number of priority writes sent*/
+	uint64_t	acks;			/*Number of priority writes acknowledged*/
+	uint64_t	unconfirmed;	/*Number of priority writes not acknowledged in time*/
+	histogram_t	rtt;			/*Time from transmission to acknowledgement*/
+} lanestats_t;
+
+/** @brief fanout_t gathers the results of an operation issued to several devices */
+typedef struct
+{
+	long			(*operation)(void *device, void *arg);	/*Operation carried out on each device*/
+	void			*arg;				/*Argument passed to the operation*/
+	uint32_t		pending;			/*Number of devices that did not complete*/
+	pthread_mutex_t	mutex;				/*Mutex for accessing pending*/
+	pthread_cond_t	condition;			/*Signaled when a device completes*/
+} fanout_t;
+
+/** @brief fanoutrequest_t is the request of a fan-out queued to the worker of one device */
+typedef struct
+{
+	evgrequest_t	request;			/*Request queued to the worker*/
+	fanout_t		*fanout;			/*Fan-out the request belongs to*/
+	void			*device;			/*Device the operation is carried out on*/
+	long			result;				/*Result of the operation*/
+} fanoutrequest_t;
+
+/** @brief scan_t is an I/O Intr scan list, posted when one of its registers changes */
 typedef struct
+{
+	uint64_t	registers;		/*Bitmask of the registers read by the records of the list*/
+	IOSCANPVT	scan;			/*Scan list*/
+} scan_t;
+
+/** @brief device_t is a structure that holds configured device information */
+typedef struct device
 {
 	char			name[NAME_LENGTH];	/*Device name*/
+	struct device	*chain;				/*Next device in the same bucket of the name hash table*/
 	in_addr_t		ip;					/*Device IP in network byte-order*/
 	in_port_t		port;				/*Device port in network byte-order*/
 	uint32_t		frequency;			/*Device event frequency in MHz*/
 	pthread_mutex_t	mutex;				/*Mutex for accessing the device*/
 	int32_t			socket;				/*Socket for communicating with the device*/
+	uint32_t		reference;			/*Tag of the next request sent to the device*/
+	uint32_t		window;				/*Number of requests allowed in flight*/
+	bool			tagged;				/*Device echoes the reference field of requests*/
+	uint32_t		records;			/*Number of messages the device accepts in one datagram*/
+	batch_t			batch;				/*Batch built through evg_batch* calls*/
+	bool			batching;			/*A batch was started and not committed*/
+	evgrequest_t	*requests[QUEUE_LENGTH];	/*Requests queued to the worker*/
+	uint32_t		requestHead;		/*Index of the next request to be carried out*/
+	uint32_t		requestTail;		/*Index past the last queued request*/
+	pthread_mutex_t	requestMutex;		/*Mutex for accessing the request queue*/
+	pthread_cond_t	requestCondition;	/*Signaled when a request is queued*/
+	uint64_t		requestTimes[QUEUE_LENGTH];	/*Time at which each queued request was queued*/
+	uint64_t		queued;				/*Time at which the request being carried out was queued, 0 if none*/
+	pthread_t		worker;				/*Thread carrying out queued requests*/
+	uint32_t		gatherWindow;		/*Time requests are gathered for before being carried out together in microseconds, 0 if disabled*/
+	bool			gathering;			/*Writes of the worker are gathered, see gatherFlush*/
+	access_t		gather[GATHER_LENGTH];	/*Gathered accesses*/
+	uint16_t		gatherExpected[GATHER_LENGTH];	/*Data expected from each gathered readback*/
+	uint32_t		gatherOwner[GATHER_LENGTH];		/*Request of the group each gathered access belongs to*/
+	uint32_t		gatherCount;		/*Number of gathered accesses*/
+	uint64_t		gatherMask;			/*Bitmask of the registers written by gathered accesses*/
+	uint32_t		gatherCurrent;		/*Request of the group being carried out*/
+	bool			gatherFailed[GATHER_REQUESTS];	/*Gathered accesses of each request of the group failed*/
+	bool			connected;			/*Socket is connected to the device*/
+	bool			online;				/*Device answered and was initialized*/
+	pthread_t		starter;			/*Thread initializing the device*/
+	uint16_t		shadow[REGISTER_COUNT];	/*Last value known to be held by each register*/
+	uint64_t		shadowValid;		/*Bitmask of registers whose shadow copy is valid*/
+	uint32_t		shadowSequence;		/*Sequence count of the shadow copy, odd while it is being updated*/
+	uint16_t		settings[REGISTER_COUNT];	/*Last value written by the IOC to each shadowed register, replayed after a reset*/
+	uint64_t		settingsValid;		/*Bitmask of registers whose last write is known to have landed*/
+	uint16_t		counterSettings[2 * NUMBER_OF_COUNTERS];	/*Last words written to the counter prescalers, low then high word per counter*/
+	uint16_t		counterValid;		/*Bitmask of the valid words of counterSettings*/
+	uint16_t		firmware;			/*Firmware version seen by the heartbeat, 0 until read*/
+	bool			reset;				/*State of the device could not be restored after a reset*/
+	uint32_t		heartbeatPeriod;	/*Period of the heartbeat in milliseconds, 0 if disabled*/
+	pthread_t		heartbeater;		/*Thread detecting device resets*/
+	verify_t		verify;				/*Write verification policy*/
+	uint16_t		expected[REGISTER_COUNT];	/*Data of writes waiting for deferred verification*/
+	uint64_t		unverified;			/*Bitmask of registers waiting for deferred verification*/
+	uint16_t		image[NUMBER_OF_SEQUENCERS][NUMBER_OF_ADDRESSES][SLOT_FIELDS];	/*Last known content of the sequencer RAM*/
+	uint8_t			imageValid[NUMBER_OF_SEQUENCERS][NUMBER_OF_ADDRESSES];		/*Bitmask of the valid fields of each slot*/
+	uint64_t		imageHash[NUMBER_OF_SEQUENCERS];	/*Rolling hash of the valid words of the image*/
+	uint8_t			unchecked[NUMBER_OF_SEQUENCERS][NUMBER_OF_ADDRESSES];		/*Bitmask of the fields of each slot waiting for deferred verification*/
+	bool			uncheckedSlots[NUMBER_OF_SEQUENCERS];	/*Some slots wait for deferred verification*/
+	uint32_t		auditPeriod;		/*Period of the audit steps in milliseconds, 0 if disabled*/
+	uint32_t		auditCursor;		/*Next slot to be audited, over both sequencers*/
+	bool			auditing;			/*Audit thread was started*/
+	pthread_t		auditor;			/*Thread auditing the sequencer RAM against the image*/
+	staging_t		staging[NUMBER_OF_SEQUENCERS];	/*Sequences staged for a later commit*/
+	sequence_t		*library;			/*Named sequences, see evg_defineSequence*/
+	stats_t			stats;				/*Instrumentation, protected by the device mutex*/
+	uint32_t		srtt;				/*Smoothed round-trip time in microseconds, 0 until measured*/
+	uint32_t		rttvar;				/*Round-trip time variation in microseconds*/
+	uint32_t		rto;				/*Retransmission timeout in microseconds*/
+	uint32_t		rtoFloor;			/*Lower bound of the retransmission timeout in microseconds*/
+	uint32_t		rtoCeiling;			/*Upper bound of the retransmission timeout in microseconds*/
+	uint64_t		backoff;			/*Time of the last backoff of the retransmission timeout*/
+	scan_t			scans[NUMBER_OF_SCANS];	/*I/O Intr scan lists*/
+	uint32_t		scanCount;			/*Number of I/O Intr scan lists*/
+	uint32_t		pollPeriod;			/*Period of the poller in milliseconds*/
+	pthread_t		poller;				/*Thread polling the registers of the I/O Intr records*/
+	uint16_t		recent[REGISTER_COUNT];		/*Data of the last read of each register*/
+	uint64_t		recentTime[REGISTER_COUNT];	/*Time at which the last read of each register was sent, 0 if unknown*/
+	uint64_t		arrival;			/*Time at which the holder of the mutex asked for the device*/
+	uint32_t		readAge;			/*Age in milliseconds below which a read is shared by later requesters*/
+	int32_t			laneSocket;			/*Socket of the priority lane, see urgent()*/
+	pthread_mutex_t	laneMutex;			/*Mutex for accessing the priority lane*/
+	pthread_cond_t	laneCondition;		/*Signaled when priority writes leave the lane*/
+	uint32_t		controlWrites;		/*Transfers writing the control register in progress, protected by the lane mutex*/
+	uint8_t			draining;			/*Bitmask of the sequencers whose commit waits without the mutex, see evg_commitSequence*/
+	pthread_cond_t	drained;			/*Signaled when a commit takes the mutex back after draining*/
+	urgent_t		lane[LANE_LENGTH];	/*Priority writes waiting for their acknowledgement, oldest first*/
+	uint32_t		laneCount;			/*Number of priority writes waiting for their acknowledgement*/
+	uint32_t		laneReference;		/*Tag of the next priority write*/
+	lanestats_t		laneStats;			/*Instrumentation of the priority lane, protected by the lane mutex*/
+	pthread_t		acknowledger;		/*Thread matching the acknowledgements of priority writes*/
 } device_t;
 
-/** @brif message_t is a structure that represents the UDP message sent/received to/from the device*/
-typedef struct
+/** @brief State of an access within a transfer */
+typedef enum
 {
-	uint8_t		access;		/*Read/Write*/
-	uint8_t		status;		/*Filled by device*/
-	uint16_t	data;		/*Register data*/
-	uint32_t	address;	/*Register address*/
-	uint32_t	reference;	/*Reserved*/
-} message_t;
+	STATE_PENDING,		/*Waiting to be sent*/
+	STATE_INFLIGHT,		/*Sent, waiting for the reply*/
+	STATE_ACKED,		/*Reply received*/
+	STATE_EXPIRED		/*No reply received in time*/
+} state_t;
+
+/** @brief Stage of a group within a transfer */
+typedef enum
+{
+	STAGE_QUEUED,		/*Waiting for its turn to be sent*/
+	STAGE_ACTIVE,		/*Being sent, or waiting for replies*/
+	STAGE_DONE			/*All accesses acknowledged*/
+} stage_t;
 
-#define NUMBER_OF_DEVICES	10	/*Maximum number of devices allowed*/
-#define NUMBER_OF_RETRIES	3	/*Maximum number of retransmissions*/
+/** @brief pending_t holds the transport state of an access */
+typedef struct
+{
+	uint32_t	reference;	/*Tag of the last transmission*/
+	uint32_t	group;		/*Index of the group the access belongs to*/
+	uint32_t	attempts;	/*Number of transmissions that went unanswered*/
+	uint64_t	time;		/*Time of the last transmission*/
+	uint64_t	deadline;	/*Time at which the last transmission expires*/
+	state_t		state;		/*State of the access*/
+	bool		sent;		/*Access was sent during the current attempt of its group*/
+} pending_t;
+
+/** @brief group_t holds the transport state of a group of chained accesses */
+typedef struct
+{
+	uint32_t	first;		/*Index of the head access*/
+	uint32_t	count;		/*Number of accesses in the group*/
+	uint32_t	outstanding;/*Accesses of the current attempt waiting for a reply*/
+	uint64_t	writes;		/*Bitmask of registers written by chained accesses*/
+	int32_t		previous;	/*Group sent through the same head register before this one*/
+	stage_t		stage;		/*Stage of the group*/
+	bool		fenced;		/*Chained accesses are held back until the head is acknowledged*/
+	bool		corrupt;	/*Chained writes of another group may have landed on this group*/
+} group_t;
+
+/** @brief transfer_t holds the state of a transfer in progress */
+typedef struct
+{
+	device_t	*device;					/*Device being accessed*/
+	access_t	*accesses;					/*Requested accesses*/
+	pending_t	*pending;					/*Transport state per access*/
+	group_t		*groups;					/*Transport state per group*/
+	uint32_t	*queue;						/*Ring of groups waiting to be sent*/
+	uint32_t	count;						/*Number of accesses*/
+	uint32_t	groupCount;					/*Number of groups*/
+	uint32_t	doneCount;					/*Number of completed groups*/
+	uint32_t	queueHead;					/*Index of the next group to be sent*/
+	uint32_t	queueTail;					/*Index past the last queued group*/
+	uint32_t	inflight[WINDOW_SIZE];		/*Accesses waiting for a reply*/
+	uint32_t	inflightCount;				/*Number of accesses waiting for a reply*/
+	int32_t		current;					/*Group being sent, -1 if none*/
+	uint32_t	cursor;						/*Next access of the group being sent*/
+	int32_t		last[REGISTER_COUNT];		/*Last group sent per head register*/
+	message_t	outgoing[BATCH_RECORDS];	/*Messages waiting to be sent in one datagram*/
+	uint32_t	outgoingCount;				/*Number of messages waiting to be sent*/
+	bool		failed;						/*Transfer has failed*/
+	bool		resent;						/*A group was sent again, selectors may hold the target of an earlier group*/
+} transfer_t;
 
 /*
  * Private members
  */
-static	device_t	devices[NUMBER_OF_DEVICES];	/*Configured devices*/
+static	device_t	**devices;					/*Configured devices*/
 static	uint32_t	deviceCount	=	0;			/*Number of configured devices*/
+static	device_t	*deviceTable[DEVICE_BUCKETS];	/*Configured devices, hashed by name*/
+static	uint32_t	startupDeadline	=	STARTUP_DEADLINE;	/*Time iocInit waits for the devices to start in milliseconds*/
+static	uint32_t	startCount		=	0;		/*Number of devices done with their first start attempt*/
+static	pthread_mutex_t	startMutex		=	PTHREAD_MUTEX_INITIALIZER;	/*Mutex for accessing startCount*/
+static	pthread_cond_t	startCondition	=	PTHREAD_COND_INITIALIZER;	/*Signaled when a device is done with its first start attempt*/
+
+/*Registers read by the commands that support I/O Intr scanning, per sequencer*/
+static	const	struct
+{
+	const char	*command;
+	uint64_t	registers[NUMBER_OF_SEQUENCERS];
+} pollable[]	=
+{
+	{"isEnabled",					{REGISTER_BIT(REGISTER_CONTROL),		REGISTER_BIT(REGISTER_CONTROL)}},
+	{"isSequencerEnabled",			{REGISTER_BIT(REGISTER_EVENT_ENABLE),	REGISTER_BIT(REGISTER_EVENT_ENABLE)}},
+	{"getRfClockSource",			{REGISTER_BIT(REGISTER_RF_CONTROL),		REGISTER_BIT(REGISTER_RF_CONTROL)}},
+	{"getRfPrescaler",				{REGISTER_BIT(REGISTER_RF_CONTROL),		REGISTER_BIT(REGISTER_RF_CONTROL)}},
+	{"getAcPrescaler",				{REGISTER_BIT(REGISTER_AC_ENABLE),		REGISTER_BIT(REGISTER_AC_ENABLE)}},
+	{"getAcSyncSource",				{REGISTER_BIT(REGISTER_AC_ENABLE),		REGISTER_BIT(REGISTER_AC_ENABLE)}},
+	{"getSequencerTriggerSource",	{REGISTER_BIT(REGISTER_EVENT_ENABLE) | REGISTER_BIT(REGISTER_AC_ENABLE), REGISTER_BIT(REGISTER_EVENT_ENABLE) | REGISTER_BIT(REGISTER_AC_ENABLE)}},
+	{"getSequencerPrescaler",		{REGISTER_BIT(REGISTER_SEQ_CLOCK_SEL1),	REGISTER_BIT(REGISTER_SEQ_CLOCK_SEL2)}},
+	{"getClock",					{REGISTER_BIT(REGISTER_USEC_DIVIDER),	REGISTER_BIT(REGISTER_USEC_DIVIDER)}},
+	{"getFirmwareVersion",			{REGISTER_BIT(REGISTER_FIRMWARE),		REGISTER_BIT(REGISTER_FIRMWARE)}},
+};
+
+/*Plain registers of a snapshot, in the order of snapshot_t, the control register last so that it is restored last*/
+static	const	evgregister_t	snapshotRegisters[SNAPSHOT_REGISTERS]	=
+{
+	REGISTER_EVENT_ENABLE,
+	REGISTER_SEQ_CLOCK_SEL1,
+	REGISTER_SEQ_CLOCK_SEL2,
+	REGISTER_AC_ENABLE,
+	REGISTER_RF_CONTROL,
+	REGISTER_USEC_DIVIDER,
+	REGISTER_CONTROL,
+};
+
+/*Values the plain registers of a snapshot take on power-up, in the order of snapshotRegisters, see heartbeat()*/
+static	const	uint16_t	powerOnValues[SNAPSHOT_REGISTERS]	=
+{
+	0x0000,
+	0x0000,
+	0x0000,
+	0x0000,
+	0x0000,
+	USEC_DIVIDER,
+	CONTROL_DISABLE,
+};
+
+/*Registers and bits of each sequencer*/
+static	const	sequencerregs_t	sequencerRegisters[NUMBER_OF_SEQUENCERS]	=
+{
+	{{REGISTER_SEQ_ADDRESS0, REGISTER_SEQ_CODE0, REGISTER_SEQ_TIME0, REGISTER_SEQ_TIME0+2}, REGISTER_SEQ_CLOCK_SEL1, EVENT_ENABLE_SEQUENCER0, AC_ENABLE_SEQ0, CONTROL_VTRG1},
+	{{REGISTER_SEQ_ADDRESS1, REGISTER_SEQ_CODE1, REGISTER_SEQ_TIME1, REGISTER_SEQ_TIME1+2}, REGISTER_SEQ_CLOCK_SEL2, EVENT_ENABLE_SEQUENCER1, AC_ENABLE_SEQ1, CONTROL_VTRG2},
+};
+
+/*Words of a counter prescaler, high word first: MXC control bits selecting the word, and position of the word in the prescaler*/
+static	const	struct
+{
+	uint16_t	select;
+	uint8_t		shift;
+} counterWords[COUNTER_WORDS]	=
+{
+	{MXC_CONTROL_HIGH_WORD,	16},
+	{0x0000,				0},
+};
 
 /*
  * Private function prototypes
  */
 /*Initializes the device*/
 static	long	init		(void);
+/*Brings a device online*/
+static	long	start		(device_t *device);
+/*Starts a device, retrying in the background until it is online*/
+static	void*	starter		(void *arg);
+/*Locks the device mutex and accounts for the wait*/
+static	void	lock		(void *dev);
+/*Returns the current monotonic time in microseconds*/
+static	uint64_t	now		(void);
+/*Adds a sample to a histogram*/
+static	void	histogramAdd	(histogram_t *histogram, uint64_t sample);
+/*Discards every datagram waiting in the socket of the device*/
+static	void	drain		(device_t *device);
+/*Prints the instrumentation of a device*/
+static	void	statsPrint	(void *dev, int detail);
 /*Reports on all configured devices*/
 static	long	report		(int detail);
+/*Hashes a device name*/
+static	uint32_t	hash	(const char *name);
+/*Carries out the requests queued to a device*/
+static	void*	worker		(void *arg);
+/*Carries out the operation of a fan-out on one device*/
+static	void	fanoutRun	(void *arg);
+/*Accounts for the completion of a fan-out on one device*/
+static	void	fanoutDone	(void *arg, long status);
+/*Polls the registers read by I/O Intr records*/
+static	void*	poller		(void *arg);
+/*Detects device resets*/
+static	void*	heartbeat	(void *arg);
+/*Brings a device that was reset back to the state set by the IOC*/
+static	long	resync		(device_t *device);
+/*Replaces a socket of a device with a new one*/
+static	long	reconnect	(device_t *device, int32_t descriptor);
 /*Writes data and checks that it was written*/
 static	long	writecheck	(void *dev, evgregister_t reg, uint16_t data);
+/*Carries out the gathered accesses*/
+static	long	gatherFlush	(device_t *device);
 /*Writes data to register*/
 static	long	writereg	(void *dev, evgregister_t reg, uint16_t data);
 /*Reads data from register*/
 static	long	readreg		(void *dev, evgregister_t reg, uint16_t *data);
+/*Reads a shadowed register without the mutex*/
+static	bool	peekreg		(device_t *device, evgregister_t reg, uint16_t *data);
+/*Starts an update of the shadow copy*/
+static	void	shadowBegin	(device_t *device);
+/*Ends an update of the shadow copy*/
+static	void	shadowEnd	(device_t *device);
+/*Returns the number of sequencer ticks per unit of time*/
+static	long	tickRate	(device_t *device, uint8_t sequencer, timeunit_t unit, double *rate);
+/*Writes a register through the priority lane, with the lane mutex held*/
+static	long	laneSend	(device_t *device, evgregister_t reg, uint16_t data);
+/*Keeps the priority lane off the control register during a transfer*/
+static	void	laneHold	(device_t *device);
+/*Lets the priority lane write the control register again*/
+static	void	laneRelease	(device_t *device);
+/*Checks whether the device echoes request tags*/
+static	long	probe		(void *dev);
+/*Carries out a list of register accesses*/
+static	long	transfer	(void *dev, access_t *accesses, uint32_t count);
+/*Reads the shadowed registers from the device*/
+static	long	refresh		(void *dev);
+/*Reads back the writes waiting for deferred verification*/
+static	long	verify		(void *dev);
+/*Reads the registers and counter prescalers of a snapshot*/
+static	long	snapshotRead	(device_t *device, uint16_t *firmware, uint16_t *registers, uint32_t *counters);
+/*Writes counter prescalers and reads them back in one batch*/
+static	long	writeCounters	(device_t *device, uint8_t first, const uint32_t *prescalers, uint8_t count);
+/*Reads a table from the sequencer RAM*/
+static	long	download	(void *dev, uint8_t sequencer, uint16_t first, uint8_t *events, uint32_t *timestamps, uint16_t count);
+/*Estimates how long the loaded sequence runs*/
+static	uint64_t	runtime	(void *dev, uint8_t sequencer);
+/*Waits for the commits draining the given sequencers to take the mutex back*/
+static	void	drainWait	(device_t *device, uint8_t sequencers);
+/*Writes a table to the sequencer RAM*/
+static	long	upload		(void *dev, uint8_t sequencer, uint16_t first, const uint8_t *events, const uint32_t *timestamps, uint16_t count, bool delta);
+/*Writes tables to the sequencer RAM in one interleaved transfer*/
+static	long	uploadTables	(void *dev, const slottable_t *tables, uint8_t count, bool delta);
+/*Reads sequencer slots back and compares them to the image*/
+static	long	checkSlots	(void *dev, uint8_t sequencer, uint16_t first, uint16_t count, bool unchecked);
+/*Maps a sequencer RAM register to the field of a slot*/
+static	int32_t	slotField	(uint16_t reg, uint8_t *sequencer);
+/*Hashes a word of the sequencer image*/
+static	uint64_t	wordHash	(uint16_t address, uint16_t field, uint16_t data);
+/*Audits the sequencer RAM in the background*/
+static	void*	auditor		(void *arg);
+/*Writes a register through the priority lane*/
+static	long	urgent		(device_t *device, evgregister_t reg, uint16_t data);
+/*Matches the acknowledgements of priority writes*/
+static	void*	acknowledger	(void *arg);
+/*Empties a batch*/
+static	void	batchInit	(batch_t *batch);
+/*Appends an access to a batch*/
+static	long	batchAdd	(batch_t *batch, uint8_t access, bool chained, evgregister_t reg, uint16_t data, uint16_t *result);
+/*Carries out a batch*/
+static	long	batchRun	(void *dev, batch_t *batch);
 
 /*
  * Function definitions
@@ -100,12 +585,15 @@ static	long	readreg		(void *dev, evgregister_t reg, uint16_t *data);
 
 /** 
  * @brief	Searches for device with given name and returns a pointer to it 
+ *
+ * Devices are looked up in a hash table of their names.
+ *
  * @return	Void pointer to found device, NULL otherwise
  */
 void*
 evg_open(char *name)
 {
-	uint32_t	i;
+	device_t	*device;
 
 	if (!name || !strlen(name) || strlen(name) >= NAME_LENGTH)
 	{
@@ -113,27 +601,188 @@ evg_open(char *name)
 		return NULL;
 	}
 
-	for (i = 0; i < deviceCount; i++)
+	for (device = deviceTable[hash(name)]; device; device = device->chain)
 	{
-		if (strcmp(devices[i].name, name) == 0)
-			return &devices[i];
+		if (strcmp(device->name, name) == 0)
+			return device;
 	}
 	return NULL;
 }
 
+/**
+ * @brief	Queues a request to the device worker thread
+ *
+ * The worker carries out requests one at a time, in the order they were queued.
+ * The request must remain valid until its function has been called.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	*request	:	Request to be queued
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_queue(void* dev, evgrequest_t *request)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !request || !request->function)
+	{
+		printf("\x1B[31m[evg][queue] Null pointer to device or request\n\x1B[0m");
+		return -1;
+	}
+
+	pthread_mutex_lock(&device->requestMutex);
+	if (device->requestTail - device->requestHead >= QUEUE_LENGTH)
+	{
+		pthread_mutex_unlock(&device->requestMutex);
+		printf("\x1B[31m[evg][queue] Request queue of %s is full\n\x1B[0m", device->name);
+		return -1;
+	}
+	device->requestTimes[device->requestTail % QUEUE_LENGTH]	=	now();
+	device->requests[device->requestTail++ % QUEUE_LENGTH]	=	request;
+	pthread_cond_signal(&device->requestCondition);
+	pthread_mutex_unlock(&device->requestMutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Carries out an operation on several devices in parallel and gathers the results
+ *
+ * The operation is queued to the worker of every device at once, and the call waits for all of
+ * them, so that a cluster-wide operation costs about the time of the slowest device rather than
+ * the sum over devices. The operation is carried out inline on devices whose worker is not
+ * running yet (before iocInit), or when called from the worker of the device itself.
+ *
+ * @param	**devs		:	Devices acted upon, NULL for every configured device
+ * @param	count		:	Number of devices, ignored if devs is NULL
+ * @param	operation	:	Operation carried out on each device, e.g. a wrapper of an evg_ function
+ * @param	*arg		:	Argument passed to the operation
+ * @param	*results	:	Result of the operation per device, may be NULL
+ * @return	0 if the operation succeeded on every device, -1 otherwise
+ */
+long
+evg_fanout(void **devs, uint32_t count, long (*operation)(void *device, void *arg), void *arg, long *results)
+{
+	int32_t			status	=	0;
+	uint32_t		i;
+	fanout_t		fanout;
+	fanoutrequest_t	*requests;
+	device_t		*device;
+
+	/*Check inputs*/
+	if (!operation)
+	{
+		printf("\x1B[31m[evg][fanout] Null pointer to operation\n\x1B[0m");
+		return -1;
+	}
+	if (!devs)
+	{
+		devs	=	(void**)devices;
+		count	=	deviceCount;
+	}
+	if (!count)
+		return 0;
+
+	requests	=	calloc(count, sizeof(fanoutrequest_t));
+	if (!requests)
+	{
+		printf("\x1B[31m[evg][fanout] Unable to allocate memory\n\x1B[0m");
+		return -1;
+	}
+	fanout.operation	=	operation;
+	fanout.arg			=	arg;
+	fanout.pending		=	count;
+	pthread_mutex_init(&fanout.mutex, NULL);
+	pthread_cond_init(&fanout.condition, NULL);
+
+	/*Issue the operation to every device*/
+	for (i = 0; i < count; i++)
+	{
+		device						=	(device_t*)devs[i];
+		requests[i].fanout			=	&fanout;
+		requests[i].device			=	device;
+		requests[i].result			=	-1;
+		requests[i].request.function	=	fanoutRun;
+		requests[i].request.arg			=	&requests[i];
+		requests[i].request.name		=	"fanout";
+		requests[i].request.complete	=	fanoutDone;
+		if (device && device->connected && !pthread_equal(pthread_self(), device->worker) && evg_queue(device, &requests[i].request) == 0)
+			continue;
+		if (device)
+			fanoutRun(&requests[i]);
+		fanoutDone(&requests[i], 0);
+	}
+
+	/*Gather the results*/
+	pthread_mutex_lock(&fanout.mutex);
+	while (fanout.pending)
+		pthread_cond_wait(&fanout.condition, &fanout.mutex);
+	pthread_mutex_unlock(&fanout.mutex);
+
+	for (i = 0; i < count; i++)
+	{
+		if (requests[i].result < 0)
+			status	=	-1;
+		if (results)
+			results[i]	=	requests[i].result;
+	}
+
+	pthread_cond_destroy(&fanout.condition);
+	pthread_mutex_destroy(&fanout.mutex);
+	free(requests);
+	return status;
+}
+
+/**
+ * @brief	Carries out the operation of a fan-out on one device
+ *
+ * @param	*arg	:	A pointer to the fan-out request
+ */
+static void
+fanoutRun(void *arg)
+{
+	fanoutrequest_t	*request	=	(fanoutrequest_t*)arg;
+
+	request->result	=	request->fanout->operation(request->device, request->fanout->arg);
+}
+
+/**
+ * @brief	Accounts for the completion of a fan-out on one device
+ *
+ * @param	*arg	:	A pointer to the fan-out request
+ * @param	status	:	-1 if the gathered IO of the request failed
+ */
+static void
+fanoutDone(void *arg, long status)
+{
+	fanoutrequest_t	*request	=	(fanoutrequest_t*)arg;
+	fanout_t		*fanout		=	request->fanout;
+
+	if (status < 0)
+		request->result	=	-1;
+
+	pthread_mutex_lock(&fanout->mutex);
+	if (!--fanout->pending)
+		pthread_cond_signal(&fanout->condition);
+	pthread_mutex_unlock(&fanout->mutex);
+}
+
 /** 
  * @brief 	Initializes all configured devices
  *
  * This function is called by iocInit during IOC initialization.
  * For each configured device, this function attemps the following:
- *	Initialize mutex
+ *	Start the worker thread that carries out record requests
  *	Create and bind UDP socket
- *	Disable the device
- *	Disable the sequencer and set its prescaler to 1
- *	Disable the ac trigger and set its prescaler to 50
- *	Set RF prescaler to 4
- *	Disable all outputs and reset their polarity
- *	Set all events to 0x7f (end-event) and timestamps to 0
+ *	Create and bind the UDP socket of the priority lane, and start its acknowledger
+ *	Start the poller that serves I/O Intr records
+ *	Start the heartbeat that detects device resets
+ *	Start the device in its own thread, see start()
+ *
+ * Devices are started concurrently. iocInit waits for them up to the startup deadline,
+ * then goes on: devices that are not online by then are reported offline and keep being
+ * started in the background. Requests to an offline device fail without touching the network.
  *
  * @return	0 on success, -1 on failure
  */
@@ -142,55 +791,241 @@ init(void)
 {
 	int32_t				status;			
 	uint32_t			device;
+	struct timespec		deadline;
 	struct sockaddr_in	address;
 
 	/*Initialize devices*/
 	for (device = 0; device < deviceCount; device++)
 	{
-		/*Initialize mutex*/
-		pthread_mutex_init(&devices[device].mutex, NULL);
+		/*Start worker*/
+		pthread_mutex_init(&devices[device]->requestMutex, NULL);
+		pthread_cond_init(&devices[device]->requestCondition, NULL);
+		status	=	pthread_create(&devices[device]->worker, NULL, worker, devices[device]);
+		if (status)
+		{
+			errlogPrintf("\x1B[31mUnable to create worker thread\n\x1B[0m");
+			return -1;
+		}
 
 		/*Create and initialize UDP socket*/
-		devices[device].socket 	=	socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-		if (devices[device].socket < 0)
+		devices[device]->socket 	=	socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (devices[device]->socket < 0)
 		{
 			errlogPrintf("\x1B[31mUnable to create socket\n\x1B[0m");
 			return -1;
 		}
 		memset((uint8_t *)&address, 0, sizeof(address));
 		address.sin_family		= 	AF_INET;
-		address.sin_port 		= 	devices[device].port;
-		address.sin_addr.s_addr	=	devices[device].ip;
-		status	=	connect(devices[device].socket, (struct sockaddr*)&address, sizeof(address));
+		address.sin_port 		= 	devices[device]->port;
+		address.sin_addr.s_addr	=	devices[device]->ip;
+		status	=	connect(devices[device]->socket, (struct sockaddr*)&address, sizeof(address));
+		if (status	<	0)
+		{
+			errlogPrintf("\x1B[31mUnable to connect to device\n\x1B[0m");
+			return -1;
+		}
+		devices[device]->connected	=	true;
+
+		/*Create the socket of the priority lane, its replies come back to it*/
+		devices[device]->laneSocket	=	socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (devices[device]->laneSocket < 0)
+		{
+			errlogPrintf("\x1B[31mUnable to create socket\n\x1B[0m");
+			return -1;
+		}
+		status	=	connect(devices[device]->laneSocket, (struct sockaddr*)&address, sizeof(address));
 		if (status	<	0)
 		{
 			errlogPrintf("\x1B[31mUnable to connect to device\n\x1B[0m");
 			return -1;
 		}
+		status	=	pthread_create(&devices[device]->acknowledger, NULL, acknowledger, devices[device]);
+		if (status)
+		{
+			errlogPrintf("\x1B[31mUnable to create acknowledger thread\n\x1B[0m");
+			return -1;
+		}
 
-		/*
-		 * Initialize the device
-		 */
+		/*Start poller*/
+		status	=	pthread_create(&devices[device]->poller, NULL, poller, devices[device]);
+		if (status)
+		{
+			errlogPrintf("\x1B[31mUnable to create poller thread\n\x1B[0m");
+			return -1;
+		}
 
-		/*Disable the device*/
-		status	=	evg_enable(&devices[device], 0);
-		if (status < 0)
+		/*Start heartbeat*/
+		status	=	pthread_create(&devices[device]->heartbeater, NULL, heartbeat, devices[device]);
+		if (status)
+		{
+			errlogPrintf("\x1B[31mUnable to create heartbeat thread\n\x1B[0m");
+			return -1;
+		}
+
+		/*Start the device*/
+		status	=	pthread_create(&devices[device]->starter, NULL, starter, devices[device]);
+		if (status)
 		{
-			printf("\x1B[31m[evg][init] Cannot enable device\n\x1B[0m");
+			errlogPrintf("\x1B[31mUnable to create starter thread\n\x1B[0m");
 			return -1;
 		}
+		pthread_detach(devices[device]->starter);
+	}
+
+	/*Wait for the devices, up to the startup deadline*/
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec		+=	startupDeadline / 1000;
+	deadline.tv_nsec	+=	(startupDeadline % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec	-=	1000000000L;
+	}
+	pthread_mutex_lock(&startMutex);
+	for (status = 0; !status && startCount < deviceCount;)
+		status	=	pthread_cond_timedwait(&startCondition, &startMutex, &deadline);
+	pthread_mutex_unlock(&startMutex);
+
+	for (device = 0; device < deviceCount; device++)
+		if (!devices[device]->online)
+			printf("\x1B[31m[evg][init] %s is offline, it will be started in the background\n\x1B[0m", devices[device]->name);
+
+	return 0;
+}
+
+/** 
+ * @brief 	Brings a device online
+ *
+ * This function attemps the following:
+ *	Probe the device for tagged (pipelined) and batched transport support
+ *	Fill the shadow copy of the register map
+ *	Disable the device
+ *	Initialize the clock
+ *	Commit the sequences loaded from files before the device was online
+ *
+ * @param	*device	:	A pointer to the device being started
+ * @return	0 on success, -1 on failure
+ */
+static long
+start(device_t *device)
+{
+	int32_t		status;
+	uint8_t		sequencer;
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];
+	staging_t	*staging;
+
+	/*Select the transport mode supported by the device*/
+	status	=	probe(device);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][start] Unable to probe %s\n\x1B[0m", device->name);
+		return -1;
+	}
+
+	/*Fill the shadow registers*/
+	status	=	evg_refresh(device);
+	if (status < 0)
+		printf("\x1B[31m[evg][start] Unable to read registers, they will be read on demand\n\x1B[0m");
+
+	/*
+	 * Initialize the device
+	 */
+
+	/*Disable the device*/
+	status	=	evg_enable(device, 0);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][start] Cannot enable device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Initialize clock*/
+	status	=	evg_setClock(device, device->frequency);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][start] Unable to set clock\n\x1B[0m");
+		return -1;
+	}
+
+	/*Commit the sequences loaded before the device was online*/
+	for (sequencer = 0; sequencer < NUMBER_OF_SEQUENCERS; sequencer++)
+	{
+		staging	=	&device->staging[sequencer];
+		if (!staging->eventCount && !staging->timestampCount)
+			continue;
+
+		/*Convert the times staged before the sequencer clock was known*/
+		if (staging->unit != TIME_TICKS)
+		{
+			status	=	evg_toTicks(device, sequencer, staging->unit, staging->times, timestamps, staging->timestampCount);
+			if (status == 0)
+				status	=	evg_stageSequence(device, sequencer, NULL, timestamps, staging->timestampCount);
+			if (status < 0)
+			{
+				printf("\x1B[31m[evg][start] Sequence staged for sequencer %u rejected, nothing written\n\x1B[0m", sequencer);
+				staging->eventCount		=	0;
+				staging->timestampCount	=	0;
+				staging->unit			=	TIME_TICKS;
+				continue;
+			}
+		}
 
-		/*Initialize clock*/
-		status	=	evg_setClock(&devices[device], devices[device].frequency);
+		status	=	evg_commitSequence(device, sequencer);
 		if (status < 0)
 		{
-			printf("\x1B[31m[evg][init] Unable to set clock\n\x1B[0m");
+			printf("\x1B[31m[evg][start] Unable to commit sequence\n\x1B[0m");
 			return -1;
 		}
 	}
+
 	return 0;
 }
 
+/** 
+ * @brief 	Starts a device, retrying in the background until it is online
+ *
+ * Only this thread talks to the device until it is online.
+ * The first attempt is accounted for in startCount, which init() waits on.
+ *
+ * @param	*arg	:	A pointer to the device
+ * @return	NULL
+ */
+static void*
+starter(void *arg)
+{
+	bool		first	=	true;
+	device_t	*device	=	(device_t*)arg;
+
+	lock(device);
+	device->starter	=	pthread_self();
+	pthread_mutex_unlock(&device->mutex);
+
+	for (;;)
+	{
+		if (start(device) == 0)
+		{
+			lock(device);
+			device->online	=	true;
+			pthread_mutex_unlock(&device->mutex);
+			if (!first)
+				printf("[evg][starter] %s is online\n", device->name);
+		}
+		if (first)
+		{
+			pthread_mutex_lock(&startMutex);
+			startCount++;
+			pthread_cond_broadcast(&startCondition);
+			pthread_mutex_unlock(&startMutex);
+			first	=	false;
+		}
+		if (device->online)
+			break;
+		sleep(RESTART_PERIOD);
+	}
+
+	return NULL;
+}
+
 long
 evg_enable(void* dev, bool enable)
 {
@@ -198,7 +1033,7 @@ evg_enable(void* dev, bool enable)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -243,17 +1078,20 @@ evg_isEnabled(void* dev)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_CONTROL, &data))
+		return (!(data&CONTROL_DISABLE_BIT));
+
+	/*Lock mutex*/
+	lock(device);
+
 	status	=	readreg(device, REGISTER_CONTROL, &data);
 	if (status < 0)
 	{
@@ -275,7 +1113,7 @@ evg_setClock(void* dev, uint16_t frequency)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -312,23 +1150,25 @@ evg_getClock(void* dev, uint16_t *frequency)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev)
 	{
 		printf("\x1B[31m[evg][getClock] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 	if (!frequency)
 	{
 		printf("\x1B[31m[evg][getClock] Null pointer to frequency\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_USEC_DIVIDER, frequency))
+		return 0;
+
+	/*Lock mutex*/
+	lock(device);
+
 	/*Act*/
 	status	=	readreg(device, REGISTER_USEC_DIVIDER, frequency);
 	if (status < 0)
@@ -352,7 +1192,7 @@ evg_setRfClockSource(void* dev, rfsource_t source)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -408,17 +1248,23 @@ evg_getRfClockSource(void* dev, rfsource_t *source)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev || !source)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_RF_CONTROL, &data))
+	{
+		*source	=	!((data&RF_CONTROL_EXTERNAL) == 0);
+		return 0;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
 	/*Read register*/
 	status	=	readreg(device, REGISTER_RF_CONTROL, &data);
 	if (status < 0)
@@ -443,7 +1289,7 @@ evg_setRfPrescaler(void* dev, uint8_t prescaler)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -491,20 +1337,26 @@ evg_getRfPrescaler(void* dev, uint8_t *prescaler)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev || !prescaler)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
-	/*Read register*/
-	status	=	readreg(device, REGISTER_RF_CONTROL, &data);
-	if (status < 0)
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_RF_CONTROL, &data))
+	{
+		*prescaler	=	(data&RF_CONTROL_DIVIDER_MASK)+1;
+		return 0;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Read register*/
+	status	=	readreg(device, REGISTER_RF_CONTROL, &data);
+	if (status < 0)
 	{
 		printf("\x1B[31m[evg][enable] Couldn't write to control register\n\x1B[0m");
 		pthread_mutex_unlock(&device->mutex);
@@ -527,7 +1379,8 @@ evg_setAcPrescaler(void* dev, uint8_t prescaler)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
+	drainWait(device, ALL_SEQUENCERS);
 
 	/*Read original value of register*/
 	status		=	readreg(device, REGISTER_AC_ENABLE, &data);
@@ -561,8 +1414,22 @@ evg_getAcPrescaler(void* dev, uint8_t *prescaler)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
+	/*Check inputs*/
+	if (!dev || !prescaler)
+	{
+		printf("\x1B[31m[evg][getAcPrescaler] Null pointer to device or prescaler\n\x1B[0m");
+		return -1;
+	}
+
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_AC_ENABLE, &data))
+	{
+		*prescaler	=	data&AC_ENABLE_DIVIDER_MASK;
+		return 0;
+	}
+
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Read original value of register*/
 	status		=	readreg(device, REGISTER_AC_ENABLE, &data);
@@ -589,7 +1456,8 @@ evg_setAcSyncSource(void* dev, acsource_t source)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
+	drainWait(device, ALL_SEQUENCERS);
 
 	/*Check inputs*/
 	if (!dev)
@@ -645,17 +1513,23 @@ evg_getAcSyncSource(void* dev, acsource_t *source)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev || !source)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_AC_ENABLE, &data))
+	{
+		*source	=	!((data&AC_ENABLE_SYNC) == 0);
+		return 0;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
 	/*Read register*/
 	status	=	readreg(device, REGISTER_AC_ENABLE, &data);
 	if (status < 0)
@@ -680,7 +1554,7 @@ evg_enableSequencer(void* dev, uint8_t sequencer, bool enable)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -705,21 +1579,10 @@ evg_enableSequencer(void* dev, uint8_t sequencer, bool enable)
 		return -1;
 	}
 
-	switch (sequencer)
-	{
-		case 0:
-			if (enable)
-				data	|=	EVENT_ENABLE_SEQUENCER0;
-			else
-				data	&=	~EVENT_ENABLE_SEQUENCER0;
-			break;
-		default:
-			if (enable)
-				data	|=	EVENT_ENABLE_SEQUENCER1;
-			else
-				data	&=	~EVENT_ENABLE_SEQUENCER1;
-			break;
-	}
+	if (enable)
+		data	|=	sequencerRegisters[sequencer].enable;
+	else
+		data	&=	~sequencerRegisters[sequencer].enable;
 
 	/*Act*/
 	status	=	writereg(device, REGISTER_EVENT_ENABLE, data);
@@ -743,23 +1606,25 @@ evg_isSequencerEnabled(void* dev, uint8_t sequencer)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_EVENT_ENABLE, &data))
+		return data & sequencerRegisters[sequencer].enable;
+
+	/*Lock mutex*/
+	lock(device);
+
 	/*Read event enable register*/
 	status	=	readreg(device, REGISTER_EVENT_ENABLE, &data);
 	if (status < 0)
@@ -769,10 +1634,7 @@ evg_isSequencerEnabled(void* dev, uint8_t sequencer)
 		return -1;
 	}
 
-	if (sequencer)
-		data	&=	EVENT_ENABLE_SEQUENCER1;
-	else 
-		data	&=	EVENT_ENABLE_SEQUENCER0;
+	data	&=	sequencerRegisters[sequencer].enable;
 
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
@@ -788,7 +1650,8 @@ evg_setSequencerTriggerSource(void* dev, uint8_t sequencer, triggersource_t sour
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
+	drainWait(device, ALL_SEQUENCERS);
 
 	/*Check inputs*/
 	if (!dev)
@@ -824,17 +1687,11 @@ evg_setSequencerTriggerSource(void* dev, uint8_t sequencer, triggersource_t sour
 	{
 		case TRIGGER_SOFT:
 			enable	|=	EVENT_ENABLE_VME;
-			if (sequencer)
-				ac		&=	~AC_ENABLE_SEQ1;
-			else 
-				ac		&=	~AC_ENABLE_SEQ0;
+			ac		&=	~sequencerRegisters[sequencer].ac;
 			break;
 		default:
 			enable	&=	~EVENT_ENABLE_VME;
-			if (sequencer)
-				ac		|=	AC_ENABLE_SEQ1;
-			else 
-				ac		|=	AC_ENABLE_SEQ0;
+			ac		|=	sequencerRegisters[sequencer].ac;
 			break;
 	}
 
@@ -867,23 +1724,28 @@ evg_getSequencerTriggerSource(void* dev, uint8_t sequencer, triggersource_t *sou
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
-	if (!dev)
+	if (!dev || !source)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
 		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_AC_ENABLE, &ac))
+	{
+		*source	=	(ac & sequencerRegisters[sequencer].ac) ? TRIGGER_AC : TRIGGER_SOFT;
+		return 0;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
 	/*Read registers*/
 	status	=	readreg(device, REGISTER_EVENT_ENABLE, &enable);
 	if (status < 0)
@@ -900,21 +1762,10 @@ evg_getSequencerTriggerSource(void* dev, uint8_t sequencer, triggersource_t *sou
 		return -1;
 	}
 
-	switch (sequencer)
-	{
-		case 0:
-			if (ac & AC_ENABLE_SEQ0)
-				*source	=	TRIGGER_AC;
-			else
-				*source	=	TRIGGER_SOFT;
-			break;
-		default:
-			if (ac & AC_ENABLE_SEQ1)
-				*source	=	TRIGGER_AC;
-			else
-				*source	=	TRIGGER_SOFT;
-			break;
-	}
+	if (ac & sequencerRegisters[sequencer].ac)
+		*source	=	TRIGGER_AC;
+	else
+		*source	=	TRIGGER_SOFT;
 
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
@@ -929,28 +1780,23 @@ evg_setSequencerPrescaler(void* dev, uint8_t sequencer, uint16_t prescaler)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
-	/*Set event frequency*/
-	if (sequencer)
+	/*Check inputs*/
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_CLOCK_SEL2, prescaler);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetSequencerPrescaler is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		printf("\x1B[31m[evg][setSequencerPrescaler] Invalid sequencer\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
-	else
+
+	/*Set event frequency*/
+	status	=	writecheck(device, sequencerRegisters[sequencer].clock, prescaler);
+	if (status < 0)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_CLOCK_SEL1, prescaler);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetSequencerPrescaler is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		errlogPrintf("\x1B[31msetSequencerPrescaler is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
 
 	/*Unlock mutex*/
@@ -965,29 +1811,32 @@ evg_getSequencerPrescaler(void* dev, uint8_t sequencer, uint16_t *prescaler)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
+	/*Check inputs*/
+	if (!dev || !prescaler)
+	{
+		printf("\x1B[31m[evg][getSequencerPrescaler] Null pointer to device or prescaler\n\x1B[0m");
+		return -1;
+	}
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
+	{
+		printf("\x1B[31m[evg][getSequencerPrescaler] Invalid sequencer\n\x1B[0m");
+		return -1;
+	}
+
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, sequencerRegisters[sequencer].clock, prescaler))
+		return 0;
+
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Read event frequency*/
-	if (sequencer)
-	{
-		status	=	readreg(device, REGISTER_SEQ_CLOCK_SEL2, prescaler);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetSequencerPrescaler is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-	}
-	else
+	status	=	readreg(device, sequencerRegisters[sequencer].clock, prescaler);
+	if (status < 0)
 	{
-		status	=	readreg(device, REGISTER_SEQ_CLOCK_SEL1, prescaler);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetSequencerPrescaler is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		errlogPrintf("\x1B[31msetSequencerPrescaler is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
 
 	/*Unlock mutex*/
@@ -996,30 +1845,80 @@ evg_getSequencerPrescaler(void* dev, uint8_t sequencer, uint16_t *prescaler)
 	return 0;
 }
 
+/**
+ * @brief	Triggers a sequencer through the priority lane, if it can
+ *
+ * Writes the cached control word, with the trigger bit set, through the priority lane, see urgent().
+ * The lane is only used while no transfer writes the control register and no table of the sequencer
+ * is being committed, see laneHold, so that the cached word is current and the trigger never
+ * overwrites another control write, nor starts a half-written table. Otherwise, or when the control
+ * register is not cached (e.g. after a write to it went unanswered), nothing is written and the caller
+ * is left to trigger the sequencer through evg_triggerSequencer, which may have to wait for the device.
+ * Never waits for the device mutex.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be triggered
+ * @return	0 on success, 1 if the lane is not available, -1 on failure
+ */
 long
-evg_triggerSequencer(void* dev, uint8_t sequencer)
+evg_laneTrigger(void* dev, uint8_t sequencer)
 {
 	uint16_t	control;
-	int32_t		status;
+	int32_t		status	=	1;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][laneTrigger] Null pointer to device\n\x1B[0m");
 		return -1;
 	}
 	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][laneTrigger] Invalid sequencer\n\x1B[0m");
 		return -1;
 	}
 
+	/*Write the cached control word through the priority lane*/
+	pthread_mutex_lock(&device->laneMutex);
+	if (!device->controlWrites && !device->staging[sequencer].committing && peekreg(device, REGISTER_CONTROL, &control))
+	{
+		status	=	laneSend(device, REGISTER_CONTROL, control | sequencerRegisters[sequencer].trigger);
+		if (status == 0)
+			device->staging[sequencer].triggered	=	now();
+	}
+	pthread_mutex_unlock(&device->laneMutex);
+
+	return status;
+}
+
+/**
+ * @brief	Triggers a sequencer
+ *
+ * Goes through the priority lane when it can, see evg_laneTrigger. Otherwise the control register
+ * is read and written under the mutex, after any commit of the sequencer, so the call may wait for
+ * an upload or a commit to end.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be triggered
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_triggerSequencer(void* dev, uint8_t sequencer)
+{
+	uint16_t	control;
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Try the priority lane first*/
+	status	=	evg_laneTrigger(dev, sequencer);
+	if (status <= 0)
+		return status;
+
+	/*Lock mutex, leaving a commit that drains the sequencer alone*/
+	lock(device);
+	drainWait(device, 1 << sequencer);
+
 	/*Read registers*/
 	status	=	readreg(device, REGISTER_CONTROL, &control);
 	if (status < 0)
@@ -1029,10 +1928,7 @@ evg_triggerSequencer(void* dev, uint8_t sequencer)
 		return -1;
 	}
 
-	if (sequencer)
-		control	|=	CONTROL_VTRG2;
-	else 
-		control	|=	CONTROL_VTRG1;
+	control	|=	sequencerRegisters[sequencer].trigger;
 
 	/*Write registers*/
 	status	=	writereg(device, REGISTER_CONTROL, control);
@@ -1042,6 +1938,7 @@ evg_triggerSequencer(void* dev, uint8_t sequencer)
 		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
+	device->staging[sequencer].triggered	=	now();
 
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
@@ -1055,67 +1952,43 @@ evg_setEvent(void* dev, uint8_t sequencer, uint16_t address, uint8_t event)
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][setEvent] Null pointer to device\n\x1B[0m");
 		return -1;
 	}
 	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][setEvent] Invalid sequencer\n\x1B[0m");
 		return -1;
 	}
 	if (address >= NUMBER_OF_ADDRESSES)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][setEvent] Invalid address\n\x1B[0m");
 		return -1;
 	}
 
+	/*Lock mutex*/
+	lock(device);
+	drainWait(device, 1 << sequencer);
+
 	/*Set address*/
-	if (sequencer)
+	status	=	writecheck(device, sequencerRegisters[sequencer].slot[0], address);
+	if (status < 0)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS1, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-
-		/*Set event*/
-		status	=	writecheck(device, REGISTER_SEQ_CODE1, event);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
-	else
-	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS0, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
 
-		/*Set event*/
-		status	=	writecheck(device, REGISTER_SEQ_CODE0, event);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+	/*Set event*/
+	status	=	writecheck(device, sequencerRegisters[sequencer].slot[1], event);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
 
 	/*Unlock mutex*/
@@ -1132,7 +2005,7 @@ evg_getEvent(void* dev, uint8_t sequencer, uint16_t address, uint8_t *event)
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -1161,43 +2034,21 @@ evg_getEvent(void* dev, uint8_t sequencer, uint16_t address, uint8_t *event)
 	}
 
 	/*Set address*/
-	if (sequencer)
+	status	=	writecheck(device, sequencerRegisters[sequencer].slot[0], address);
+	if (status < 0)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS1, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-
-		/*Read event*/
-		status	=	readreg(device, REGISTER_SEQ_CODE1, &readback);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
-	else
-	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS0, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
 
-		/*Read event*/
-		status	=	readreg(device, REGISTER_SEQ_CODE0, &readback);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+	/*Read event*/
+	status	=	readreg(device, sequencerRegisters[sequencer].slot[1], &readback);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31msetEvent is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
 	*event	=	readback;
 
@@ -1210,84 +2061,54 @@ evg_getEvent(void* dev, uint8_t sequencer, uint16_t address, uint8_t *event)
 long
 evg_setTimestamp(void* dev, uint8_t sequencer, uint16_t address, uint32_t timestamp)
 {
-	int32_t		status;
-	device_t	*device	=	(device_t*)dev;
-
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	uint16_t			high	=	0;
+	uint16_t			low		=	0;
+	int32_t				status;
+	const evgregister_t	*regs;
+	batch_t				batch;
+	device_t		*device	=	(device_t*)dev;
 
 	/*Check inputs*/
 	if (!dev)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][setTimestamp] Null pointer to device\n\x1B[0m");
 		return -1;
 	}
 	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][setTimestamp] Invalid sequencer\n\x1B[0m");
 		return -1;
 	}
 	if (address >= NUMBER_OF_ADDRESSES)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][setTimestamp] Invalid address\n\x1B[0m");
 		return -1;
 	}
 
-	/*Set address*/
-	if (sequencer)
+	/*Lock mutex*/
+	lock(device);
+	drainWait(device, 1 << sequencer);
+
+	/*Set address, write new timestamp, and read it back in one batch*/
+	regs	=	sequencerRegisters[sequencer].slot;
+	batchInit(&batch);
+	batchAdd(&batch, ACCESS_WRITE, false, regs[0], address, NULL);
+	batchAdd(&batch, ACCESS_WRITE, true, regs[2], timestamp>>16, NULL);
+	batchAdd(&batch, ACCESS_WRITE, true, regs[3], timestamp, NULL);
+	batchAdd(&batch, ACCESS_READ, true, regs[2], 0, &high);
+	batchAdd(&batch, ACCESS_READ, true, regs[3], 0, &low);
+	status	=	batchRun(device, &batch);
+	if (status < 0)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS1, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-
-		/*Write new timestamp*/
-		status	=	writecheck(device, REGISTER_SEQ_TIME1, timestamp>>16);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestampe is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-		status	=	writecheck(device, REGISTER_SEQ_TIME1+2, timestamp);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
-	else
+	if (high != (uint16_t)(timestamp>>16) || low != (uint16_t)timestamp)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS0, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-
-		/*Write new timestamp*/
-		status	=	writecheck(device, REGISTER_SEQ_TIME0, timestamp>>16);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestampe is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-		status	=	writecheck(device, REGISTER_SEQ_TIME0+2, timestamp);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
+		errlogPrintf("\x1B[31msetTimestamp is unsuccessful: readback mismatch\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
 
 	/*Unlock mutex*/
@@ -1304,7 +2125,7 @@ evg_getTimestamp(void* dev, uint8_t sequencer, uint16_t address, uint32_t *times
 	device_t	*device	=	(device_t*)dev;
 
 	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
+	lock(device);
 
 	/*Check inputs*/
 	if (!dev)
@@ -1333,64 +2154,32 @@ evg_getTimestamp(void* dev, uint8_t sequencer, uint16_t address, uint32_t *times
 	}
 
 	/*Set address*/
-	if (sequencer)
+	status	=	writecheck(device, sequencerRegisters[sequencer].slot[0], address);
+	if (status < 0)
 	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS1, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-
-		/*Read timestamp*/
-		status	=	readreg(device, REGISTER_SEQ_TIME1, &data);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestampe is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-		*timestamp	=	data << 16;
-
-		status	=	readreg(device, REGISTER_SEQ_TIME1+2, &data);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-		*timestamp	|=	data;
+		errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
-	else
-	{
-		status	=	writecheck(device, REGISTER_SEQ_ADDRESS0, address);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
 
-		/*Read timestamp*/
-		status	=	readreg(device, REGISTER_SEQ_TIME0, &data);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestampe is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-		*timestamp	=	data << 16;
+	/*Read timestamp*/
+	status	=	readreg(device, sequencerRegisters[sequencer].slot[2], &data);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31msetTimestampe is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+	*timestamp	=	data << 16;
 
-		status	=	readreg(device, REGISTER_SEQ_TIME0+2, &data);
-		if (status < 0)
-		{
-			errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
-			pthread_mutex_unlock(&device->mutex);
-			return -1;
-		}
-		*timestamp	|=	data;
+	status	=	readreg(device, sequencerRegisters[sequencer].slot[3], &data);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
 	}
+	*timestamp	|=	data;
 
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
@@ -1398,28 +2187,43 @@ evg_getTimestamp(void* dev, uint8_t sequencer, uint16_t address, uint32_t *times
 	return 0;
 }
 
+/**
+ * @brief	Uploads a table of events and timestamps to the sequencer RAM
+ *
+ * Loads addresses 0 to count-1 of the sequencer in one transfer while holding the device mutex.
+ * Each slot is a chained group of address, event, and timestamp writes, and the transport keeps
+ * several slots in flight, so the upload is bound by the link bandwidth rather than its latency.
+ * Unless verification is disabled, the whole table is then read back in a single pipelined pass
+ * and the slots that differ are reported.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be loaded
+ * @param	*events		:	Event codes, one per address
+ * @param	*timestamps	:	Timestamps, one per address
+ * @param	count		:	Number of addresses to load
+ * @return	0 on success, -1 on failure
+ */
 long
-evg_setSoftwareEvent(void* dev, uint8_t event)
+evg_loadSequence(void* dev, uint8_t sequencer, const uint8_t *events, const uint32_t *timestamps, uint16_t count)
 {
 	int32_t		status;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
 	if (!dev)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][loadSequence] Null pointer to device\n\x1B[0m");
 		return -1;
 	}
 
-	/*Write software event*/
-	status	=	writereg(device, REGISTER_SW_EVENT, event);
+	/*Lock mutex*/
+	lock(device);
+
+	/*Write slots*/
+	status	=	upload(device, sequencer, 0, events, timestamps, count, false);
 	if (status < 0)
 	{
-		errlogPrintf("\x1B[31msetTimestamp is unsuccessful\n\x1B[0m");
+		printf("\x1B[31m[evg][loadSequence] Couldn't write sequence\n\x1B[0m");
 		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
@@ -1429,140 +2233,250 @@ evg_setSoftwareEvent(void* dev, uint8_t event)
 
 	return 0;
 }
-
+/**
+ * @brief	Uploads a table of events and timestamps to each sequencer
+ *
+ * Loads addresses 0 to counts[i]-1 of each sequencer i in one transfer while holding the device mutex.
+ * The slots of the sequencers are interleaved in the pipeline, see uploadTables, so loading both
+ * sequencers takes about as long as loading the longest table alone.
+ * A sequencer whose count is 0 is left untouched.
+ * Unless verification is disabled, the tables are then read back in a single pipelined pass.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	**events	:	Event codes, one table per sequencer
+ * @param	**timestamps	:	Timestamps, one table per sequencer
+ * @param	*counts		:	Number of addresses to load, one per sequencer
+ * @return	0 on success, -1 on failure
+ */
 long
-evg_setCounterPrescaler(void* dev, uint8_t counter, uint32_t prescaler)
+evg_loadSequences(void* dev, const uint8_t **events, const uint32_t **timestamps, const uint16_t *counts)
 {
 	int32_t		status;
+	uint8_t		sequencer;
+	uint8_t		n		=	0;
+	slottable_t	tables[NUMBER_OF_SEQUENCERS];
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
-	if (!dev)
+	if (!dev || !events || !timestamps || !counts)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][loadSequences] Null pointer to device or sequences\n\x1B[0m");
 		return -1;
 	}
-	if (counter >= NUMBER_OF_COUNTERS)
+	for (sequencer = 0; sequencer < NUMBER_OF_SEQUENCERS; sequencer++)
+		if (counts[sequencer])
+			tables[n++]	=	(slottable_t){sequencer, 0, events[sequencer], timestamps[sequencer], counts[sequencer]};
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Write slots*/
+	status	=	uploadTables(device, tables, n, false);
+	if (status < 0)
 	{
-		printf("\x1B[31m[evg][setCounterPrescaler] Invalid counter.\n\x1B[0m");
+		printf("\x1B[31m[evg][loadSequences] Couldn't write sequences\n\x1B[0m");
 		pthread_mutex_unlock(&device->mutex);
 		return -1;
 	}
 
-	/*Select counter and high prescaler word*/
-	status	=	writecheck(device, REGISTER_MXC_CONTROL, counter | MXC_CONTROL_HIGH_WORD);
-	if (status < 0)
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+
+/**
+ * @brief	Stages a table of events and timestamps for a later commit
+ *
+ * Only copies the table to the staging buffer of the sequencer, the device is not accessed,
+ * so a table can be prepared while the sequencer runs. Either table may be NULL,
+ * in which case the part of the staging buffer staged before is kept.
+ * While a commit of the sequencer drains the running sequence, the table waits for the commit
+ * to end, so that the commit writes the table it gated, see drainWait.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer the table is meant for
+ * @param	*events		:	Event codes, one per address
+ * @param	*timestamps	:	Timestamps, one per address
+ * @param	count		:	Number of addresses staged
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_stageSequence(void* dev, uint8_t sequencer, const uint8_t *events, const uint32_t *timestamps, uint16_t count)
+{
+	staging_t	*staging;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
 	{
-		errlogPrintf("\x1B[31m[evg][]\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][stageSequence] Null pointer to device\n\x1B[0m");
 		return -1;
 	}
-
-	/*Write high prescaler word*/
-	status	=	writecheck(device, REGISTER_MXC_PRESCALER, (uint16_t)(prescaler>>16));
-	if (status < 0)
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][stageSequence] Invalid sequencer\n\x1B[0m");
 		return -1;
 	}
-
-	/*Select counter and low prescaler word*/
-	status	=	writecheck(device, REGISTER_MXC_CONTROL, counter);
-	if (status < 0)
+	if (!events && !timestamps)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][stageSequence] Null pointer to sequence\n\x1B[0m");
 		return -1;
 	}
-
-	/*Write low prescaler word*/
-	status	=	writecheck(device, REGISTER_MXC_PRESCALER, (uint16_t)(prescaler));
-	if (status < 0)
+	if (count > NUMBER_OF_ADDRESSES)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][stageSequence] Sequence is too long\n\x1B[0m");
 		return -1;
 	}
 
+	/*Lock mutex, after a commit draining the sequencer*/
+	lock(device);
+	drainWait(device, 1 << sequencer);
+
+	/*Act*/
+	staging	=	&device->staging[sequencer];
+	if (events)
+	{
+		memcpy(staging->events, events, count * sizeof(*events));
+		staging->eventCount		=	count;
+	}
+	if (timestamps)
+	{
+		memcpy(staging->timestamps, timestamps, count * sizeof(*timestamps));
+		staging->timestampCount	=	count;
+		staging->unit			=	TIME_TICKS;
+	}
+
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
 
 	return 0;
 }
 
+/**
+ * @brief	Loads a sequence file into the sequencer RAM
+ *
+ * The file is read by evg_parseSequence, its times being converted with the clock of the sequencer,
+ * see evg_stageSequenceTimes, then staged and committed through evg_commitSequence.
+ * If the device is not online yet, e.g. when called before iocInit, the sequence stays
+ * staged and is converted and committed when the device is started.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be loaded
+ * @param	*path		:	Path of the sequence file
+ * @return	0 on success, -1 on failure
+ */
 long
-evg_getCounterPrescaler(void* dev, uint8_t counter, uint32_t *prescaler)
+evg_loadSequenceFile(void* dev, uint8_t sequencer, const char *path)
 {
-	uint16_t	data	=	0;
 	int32_t		status;
+	uint16_t	count;
+	uint8_t		*events;
+	double		*times;
+	timeunit_t	unit;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
-	if (!dev)
+	if (!dev || !path)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][loadSequenceFile] Null pointer to device or path\n\x1B[0m");
 		return -1;
 	}
-	if (counter >= NUMBER_OF_COUNTERS)
+
+	/*Read file*/
+	events	=	malloc(NUMBER_OF_ADDRESSES * sizeof(*events));
+	times	=	malloc(NUMBER_OF_ADDRESSES * sizeof(*times));
+	if (!events || !times)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][loadSequenceFile] Unable to allocate memory\n\x1B[0m");
+		free(events);
+		free(times);
 		return -1;
 	}
-	if (!prescaler)
+	status	=	evg_parseSequence(path, events, times, &unit, &count);
+	if (status == 0)
+		status	=	evg_stageSequenceTimes(device, sequencer, events, times, unit, count);
+	free(events);
+	free(times);
+	if (status < 0)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][loadSequenceFile] Couldn't load %s\n\x1B[0m", path);
 		return -1;
 	}
 
-	/*Select counter and high prescaler word*/
-	status	=	writecheck(device, REGISTER_MXC_CONTROL, counter | MXC_CONTROL_HIGH_WORD);
-	if (status < 0)
+	/*Commit now, or when the device is started*/
+	if (!device->online)
+		return 0;
+	return evg_commitSequence(device, sequencer);
+}
+
+/**
+ * @brief	Adds a sequence file to the library of named sequences of the device
+ *
+ * The file is parsed and validated once, see evg_parseSequence, and kept in memory. Its times
+ * are kept in the unit of the file and converted with the clock of the sequencer it is selected on.
+ * Defining a name again replaces its sequence.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	*name	:	Name of the sequence
+ * @param	*path	:	Path of the sequence file
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_defineSequence(void* dev, const char *name, const char *path)
+{
+	int32_t		status;
+	sequence_t	*sequence;
+	sequence_t	*entry;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !path)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][defineSequence] Null pointer to device or path\n\x1B[0m");
 		return -1;
 	}
-
-	/*Read high prescaler word*/
-	status	=	readreg(device, REGISTER_MXC_PRESCALER, &data);
-	if (status < 0)
+	if (!name || !strlen(name) || strlen(name) >= NAME_LENGTH)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][defineSequence] Missing or incorrect name\n\x1B[0m");
 		return -1;
 	}
-	*prescaler	=	data;
-	*prescaler	<<=	16;
 
-	/*Select counter and low prescaler word*/
-	status	=	writecheck(device, REGISTER_MXC_CONTROL, counter);
-	if (status < 0)
+	/*Read file*/
+	sequence	=	calloc(1, sizeof(sequence_t));
+	if (!sequence)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][defineSequence] Unable to allocate memory\n\x1B[0m");
 		return -1;
 	}
-
-	/*Read low prescaler word*/
-	status	=	readreg(device, REGISTER_MXC_PRESCALER, &data);
+	status	=	evg_parseSequence(path, sequence->events, sequence->times, &sequence->unit, &sequence->count);
 	if (status < 0)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][defineSequence] Couldn't read %s\n\x1B[0m", path);
+		free(sequence);
 		return -1;
 	}
-	*prescaler	|=	data;
+	strcpy(sequence->name, name);
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Add it, or replace the sequence of the same name*/
+	for (entry = device->library; entry; entry = entry->next)
+		if (strcmp(entry->name, name) == 0)
+			break;
+	if (entry)
+	{
+		sequence->next	=	entry->next;
+		*entry			=	*sequence;
+		free(sequence);
+	}
+	else
+	{
+		sequence->next	=	device->library;
+		device->library	=	sequence;
+	}
 
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
@@ -1570,195 +2484,4418 @@ evg_getCounterPrescaler(void* dev, uint8_t counter, uint32_t *prescaler)
 	return 0;
 }
 
+/**
+ * @brief	Programs a named sequence of the library
+ *
+ * The sequence is staged with the clock of the sequencer, see evg_stageSequenceTimes, and committed
+ * through evg_commitSequence, which only writes the slots that differ from the sequencer image,
+ * so switching between modes costs the difference between them. If the device is not online yet,
+ * the sequence is converted and committed when the device is started.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be programmed
+ * @param	*name		:	Name of the sequence
+ * @return	0 on success, -1 on failure
+ */
 long
-evg_getFirmwareVersion(void* dev, uint16_t *version)
+evg_selectSequence(void* dev, uint8_t sequencer, const char *name)
 {
 	int32_t		status;
+	sequence_t	*entry;
+	sequence_t	*copy;
 	device_t	*device	=	(device_t*)dev;
 
-	/*Lock mutex*/
-	pthread_mutex_lock(&device->mutex);
-
 	/*Check inputs*/
-	if (!dev || !version)
+	if (!dev || !name)
 	{
-		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
-		pthread_mutex_unlock(&device->mutex);
+		printf("\x1B[31m[evg][selectSequence] Null pointer to device or name\n\x1B[0m");
+		return -1;
+	}
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
+	{
+		printf("\x1B[31m[evg][selectSequence] Invalid sequencer\n\x1B[0m");
 		return -1;
 	}
 
-	/*Read version*/
-	status	=	readreg(device, REGISTER_FIRMWARE, version);
-	if (status < 0)
+	copy	=	malloc(sizeof(sequence_t));
+	if (!copy)
 	{
-		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
+		printf("\x1B[31m[evg][selectSequence] Unable to allocate memory\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Find the sequence*/
+	for (entry = device->library; entry; entry = entry->next)
+		if (strcmp(entry->name, name) == 0)
+			break;
+	if (!entry)
+	{
+		printf("\x1B[31m[evg][selectSequence] Sequence %s is not defined\n\x1B[0m", name);
 		pthread_mutex_unlock(&device->mutex);
+		free(copy);
 		return -1;
 	}
+	*copy	=	*entry;
 
 	/*Unlock mutex*/
 	pthread_mutex_unlock(&device->mutex);
 
-	return 0;
+	/*Stage the sequence, converting its times*/
+	status	=	evg_stageSequenceTimes(device, sequencer, copy->events, copy->times, copy->unit, copy->count);
+	free(copy);
+	if (status < 0)
+		return -1;
+
+	/*Commit now, or when the device is started*/
+	if (!device->online)
+		return 0;
+	return evg_commitSequence(device, sequencer);
 }
 
 /**
- * @brief	Writes device's 16-bit register and checks the register was written
+ * @brief	Commits the staged table to the sequencer RAM in one burst
  *
- * Prepares UDP message, sends it to device
- * Reads back the value in the register and validates the write
+ * This function attemps the following:
+ *	Keeps software triggers of the sequencer off the priority lane, see evg_triggerSequencer
+ *	Gates the AC trigger of the sequencer through REGISTER_AC_ENABLE, if the sequencer is triggered from AC
+ *	Waits for a sequence that may be running to reach EVENT_END_SEQUENCE, as estimated from the sequencer image,
+ *	from the last software trigger if the sequencer is not triggered from AC, without holding the mutex
+ *	Writes the slots of the staged table that differ from the image in one transfer
+ *	Restores REGISTER_AC_ENABLE
+ * The sequencer therefore never starts on a half-written table, and the trigger is gated only
+ * for the time it takes to write the changes. While the running sequence ends, the rest of the device
+ * stays available; other commits, and whatever would stage a table for the sequencer, write its RAM,
+ * trigger it or change the AC trigger gates, wait for the commit to end, see drainWait.
  *
- * @param	*dev	:	A pointer to the device being acted upon
- * @param	reg		:	Address of register to be written
- * @param	data	:	16-bit data to be written to device
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be committed
  * @return	0 on success, -1 on failure
  */
-static long	
-writecheck(void *dev, evgregister_t reg, uint16_t data)
+long
+evg_commitSequence(void* dev, uint8_t sequencer)
 {
-	uint16_t	readback;
 	int32_t		status;
+	uint32_t	time;
+	uint64_t	start;
+	uint16_t	ac;
+	uint16_t	gate;
+	staging_t	*staging;
 	device_t	*device	=	(device_t*)dev;
 
 	/*Check inputs*/
 	if (!dev)
+	{
+		printf("\x1B[31m[evg][commitSequence] Null pointer to device\n\x1B[0m");
 		return -1;
-
-	/*Write data*/
-	status	=	writereg(device, reg, data);
-	if (status < 0)
+	}
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
+	{
+		printf("\x1B[31m[evg][commitSequence] Invalid sequencer\n\x1B[0m");
 		return -1;
+	}
 
-	/*Check that data was updated*/
-	status	=	readreg(device, reg, &readback);
-	if (status < 0)
-		return -1;
+	/*Lock mutex, after the commits draining a sequence*/
+	lock(device);
+	drainWait(device, ALL_SEQUENCERS);
 
-	if (readback != data)
+	staging	=	&device->staging[sequencer];
+	if (!staging->eventCount && !staging->timestampCount)
+	{
+		printf("\x1B[31m[evg][commitSequence] Nothing was staged\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
 		return -1;
-
-	return 0;
-}
-
+	}
+	if (staging->unit != TIME_TICKS)
+	{
+		printf("\x1B[31m[evg][commitSequence] Staged times wait for the device to be started\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Keep software triggers off the priority lane*/
+	pthread_mutex_lock(&device->laneMutex);
+	staging->committing	=	true;
+	pthread_mutex_unlock(&device->laneMutex);
+
+	/*Gate the AC trigger*/
+	status	=	readreg(device, REGISTER_AC_ENABLE, &ac);
+	gate	=	ac & sequencerRegisters[sequencer].ac;
+	if (status >= 0 && gate)
+		status	=	writereg(device, REGISTER_AC_ENABLE, ac & ~gate);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][commitSequence] Couldn't gate AC trigger\n\x1B[0m");
+		pthread_mutex_lock(&device->laneMutex);
+		staging->committing	=	false;
+		pthread_mutex_unlock(&device->laneMutex);
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Let a running sequence end, counting from the last software trigger unless triggered from AC*/
+	time	=	runtime(device, sequencer);
+	start	=	now();
+	if (!gate)
+		time	=	staging->triggered && staging->triggered + time > start ? staging->triggered + time - start : 0;
+	if (time)
+	{
+		device->draining	|=	1 << sequencer;
+		pthread_mutex_unlock(&device->mutex);
+		usleep(time);
+		lock(device);
+		device->draining	&=	~(1 << sequencer);
+		pthread_cond_broadcast(&device->drained);
+	}
+
+	/*Write the changes*/
+	if (staging->eventCount == staging->timestampCount)
+		status	=	upload(device, sequencer, 0, staging->events, staging->timestamps, staging->eventCount, true);
+	else
+	{
+		status	=	0;
+		if (staging->eventCount)
+			status	|=	upload(device, sequencer, 0, staging->events, NULL, staging->eventCount, true);
+		if (staging->timestampCount)
+			status	|=	upload(device, sequencer, 0, NULL, staging->timestamps, staging->timestampCount, true);
+	}
+	if (status < 0)
+		printf("\x1B[31m[evg][commitSequence] Couldn't write sequence\n\x1B[0m");
+	else
+	{
+		staging->eventCount		=	0;
+		staging->timestampCount	=	0;
+	}
+
+	/*Restore the AC trigger, even if the sequence could not be written*/
+	if (gate && writereg(device, REGISTER_AC_ENABLE, ac) < 0)
+	{
+		printf("\x1B[31m[evg][commitSequence] Couldn't restore AC trigger\n\x1B[0m");
+		status	=	-1;
+	}
+	pthread_mutex_lock(&device->laneMutex);
+	staging->committing	=	false;
+	pthread_mutex_unlock(&device->laneMutex);
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return status < 0 ? -1 : 0;
+}
+
+/**
+ * @brief	Downloads a table of events and timestamps from the sequencer RAM
+ *
+ * Reads addresses 0 to count-1 of the sequencer, see evg_readSlots.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be read
+ * @param	*events		:	Event codes read, one per address
+ * @param	*timestamps	:	Timestamps read, one per address
+ * @param	count		:	Number of addresses to read
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_readSequence(void* dev, uint8_t sequencer, uint8_t *events, uint32_t *timestamps, uint16_t count)
+{
+	return evg_readSlots(dev, sequencer, 0, events, timestamps, count);
+}
+
+/**
+ * @brief	Downloads a block of slots from the sequencer RAM
+ *
+ * Reads addresses first to first+count-1 of the sequencer in one pipelined transfer while holding the device mutex.
+ * Either table may be NULL, in which case that part of the slots is not read.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be read
+ * @param	first		:	First address to read, the tables start with it
+ * @param	*events		:	Event codes read, one per address
+ * @param	*timestamps	:	Timestamps read, one per address
+ * @param	count		:	Number of addresses to read
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_readSlots(void* dev, uint8_t sequencer, uint16_t first, uint8_t *events, uint32_t *timestamps, uint16_t count)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][readSlots] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Read slots*/
+	status	=	download(device, sequencer, first, events, timestamps, count);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][readSlots] Couldn't read sequence\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Programs a table of events and timestamps, writing only the slots that changed
+ *
+ * The driver keeps an image of the sequencer RAM, updated by every access to it.
+ * The table is compared to that image, and only the words that differ, or that are unknown,
+ * are written. A typical edit costs a single transfer of a few accesses.
+ * Either table may be NULL, in which case that part of the slots is left untouched.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be programmed
+ * @param	*events		:	Event codes, one per address
+ * @param	*timestamps	:	Timestamps, one per address
+ * @param	count		:	Number of addresses to program
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_applySequence(void* dev, uint8_t sequencer, const uint8_t *events, const uint32_t *timestamps, uint16_t count)
+{
+	return evg_applySlots(dev, sequencer, 0, events, timestamps, count);
+}
+
+/**
+ * @brief	Programs a block of slots, writing only the slots that changed
+ *
+ * Compares addresses first to first+count-1 to the image, see evg_applySequence.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be programmed
+ * @param	first		:	First address to program, the tables start with it
+ * @param	*events		:	Event codes, one per address
+ * @param	*timestamps	:	Timestamps, one per address
+ * @param	count		:	Number of addresses to program
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_applySlots(void* dev, uint8_t sequencer, uint16_t first, const uint8_t *events, const uint32_t *timestamps, uint16_t count)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][applySlots] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Write changed slots*/
+	status	=	upload(device, sequencer, first, events, timestamps, count, true);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][applySlots] Couldn't write sequence\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Converts a table of times to timestamps in ticks of the sequencer clock
+ *
+ * The rate of the sequencer clock, i.e. the event frequency divided by the sequencer prescaler,
+ * is computed once from the shadow copy, see tickRate, so a conversion normally costs no access
+ * to the device. A time that is negative, not a number, or beyond 32 bits of ticks, or a timestamp
+ * that does not increase strictly, rejects the whole table. The conversion loop only accumulates
+ * whether any slot is invalid; a rejected table is then scanned again to report the first offending slot.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer whose clock the timestamps are meant for
+ * @param	unit		:	Unit of the times
+ * @param	*times		:	Times, one per address
+ * @param	*timestamps	:	Timestamps in ticks, one per address
+ * @param	count		:	Number of addresses to convert
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_toTicks(void* dev, uint8_t sequencer, timeunit_t unit, const double *times, uint32_t *timestamps, uint16_t count)
+{
+	uint32_t	i;
+	double		rate;
+	double		tick;
+	double		previous	=	-1;
+	bool		invalid		=	false;
+	device_t	*device		=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !times || !timestamps)
+	{
+		printf("\x1B[31m[evg][toTicks] Null pointer to device or table\n\x1B[0m");
+		return -1;
+	}
+	if (count > NUMBER_OF_ADDRESSES)
+	{
+		printf("\x1B[31m[evg][toTicks] Sequence is too long\n\x1B[0m");
+		return -1;
+	}
+	if (tickRate(device, sequencer, unit, &rate) < 0)
+		return -1;
+
+	/*Convert the whole table, only noting whether a slot is invalid*/
+	for (i = 0; i < count; i++)
+	{
+		tick			=	nearbyint(times[i] * rate);
+		invalid			|=	!(tick >= 0 && tick <= UINT32_MAX) | !(tick > previous);
+		timestamps[i]	=	(tick >= 0 && tick <= UINT32_MAX) ? (uint32_t)tick : 0;
+		previous		=	tick;
+	}
+	if (!invalid)
+		return 0;
+
+	/*Report the first offending slot*/
+	for (i = 0, previous = -1; i < count; i++)
+	{
+		tick	=	nearbyint(times[i] * rate);
+		if (!(tick >= 0 && tick <= UINT32_MAX))
+		{
+			printf("\x1B[31m[evg][toTicks] Time of slot %u does not fit in 32 bits of ticks\n\x1B[0m", i);
+			break;
+		}
+		if (!(tick > previous))
+		{
+			printf("\x1B[31m[evg][toTicks] Time of slot %u does not increase\n\x1B[0m", i);
+			break;
+		}
+		previous	=	tick;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief	Converts a table of timestamps in ticks of the sequencer clock to times
+ *
+ * See evg_toTicks.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer whose clock the timestamps are counted in
+ * @param	unit		:	Unit of the times
+ * @param	*timestamps	:	Timestamps in ticks, one per address
+ * @param	*times		:	Times, one per address
+ * @param	count		:	Number of addresses to convert
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_fromTicks(void* dev, uint8_t sequencer, timeunit_t unit, const uint32_t *timestamps, double *times, uint16_t count)
+{
+	uint32_t	i;
+	double		rate;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !times || !timestamps)
+	{
+		printf("\x1B[31m[evg][fromTicks] Null pointer to device or table\n\x1B[0m");
+		return -1;
+	}
+	if (tickRate(device, sequencer, unit, &rate) < 0)
+		return -1;
+
+	/*Convert*/
+	for (i = 0; i < count; i++)
+		times[i]	=	timestamps[i] / rate;
+
+	return 0;
+}
+
+/**
+ * @brief	Uploads a table of events and times to the sequencer RAM
+ *
+ * The times are converted and checked by evg_toTicks before anything is written, so a table
+ * that is rejected leaves the sequencer untouched. See evg_loadSequence.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be loaded
+ * @param	*events		:	Event codes, one per address
+ * @param	*times		:	Times, one per address
+ * @param	unit		:	Unit of the times
+ * @param	count		:	Number of addresses to load
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_loadSequenceTimes(void* dev, uint8_t sequencer, const uint8_t *events, const double *times, timeunit_t unit, uint16_t count)
+{
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];
+
+	if (evg_toTicks(dev, sequencer, unit, times, timestamps, count) < 0)
+	{
+		printf("\x1B[31m[evg][loadSequenceTimes] Sequence rejected, nothing written\n\x1B[0m");
+		return -1;
+	}
+
+	return evg_loadSequence(dev, sequencer, events, timestamps, count);
+}
+
+/**
+ * @brief	Stages a table of events and times for a later commit
+ *
+ * The times are converted by evg_toTicks with the clock of the sequencer at the time of the call.
+ * If the device is not online yet, they are staged as they are and converted when the device
+ * is started, once the prescaler of the sequencer can be read. See evg_stageSequence.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer the table is meant for
+ * @param	*events		:	Event codes, one per address, may be NULL
+ * @param	*times		:	Times, one per address, may be NULL
+ * @param	unit		:	Unit of the times
+ * @param	count		:	Number of addresses staged
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_stageSequenceTimes(void* dev, uint8_t sequencer, const uint8_t *events, const double *times, timeunit_t unit, uint16_t count)
+{
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];
+	staging_t	*staging;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Keep the times until the device is started*/
+	if (dev && times && unit != TIME_TICKS && !device->online)
+	{
+		if (sequencer >= NUMBER_OF_SEQUENCERS || count > NUMBER_OF_ADDRESSES)
+		{
+			printf("\x1B[31m[evg][stageSequenceTimes] Invalid sequencer or sequence too long\n\x1B[0m");
+			return -1;
+		}
+		if (events && evg_stageSequence(dev, sequencer, events, NULL, count) < 0)
+			return -1;
+
+		lock(device);
+		drainWait(device, 1 << sequencer);
+		staging	=	&device->staging[sequencer];
+		memcpy(staging->times, times, count * sizeof(*times));
+		staging->timestampCount	=	count;
+		staging->unit			=	unit;
+		pthread_mutex_unlock(&device->mutex);
+
+		return 0;
+	}
+
+	if (times && evg_toTicks(dev, sequencer, unit, times, timestamps, count) < 0)
+	{
+		printf("\x1B[31m[evg][stageSequenceTimes] Sequence rejected, nothing staged\n\x1B[0m");
+		return -1;
+	}
+
+	return evg_stageSequence(dev, sequencer, events, times ? timestamps : NULL, count);
+}
+
+/**
+ * @brief	Downloads a block of slots from the sequencer RAM, with times
+ *
+ * See evg_readSlots and evg_fromTicks.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be read
+ * @param	first		:	First address to read, the tables start with it
+ * @param	*events		:	Event codes read, one per address, may be NULL
+ * @param	*times		:	Times read, one per address, may be NULL
+ * @param	unit		:	Unit of the times
+ * @param	count		:	Number of addresses to read
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_readSlotTimes(void* dev, uint8_t sequencer, uint16_t first, uint8_t *events, double *times, timeunit_t unit, uint16_t count)
+{
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];
+
+	if (count > NUMBER_OF_ADDRESSES)
+	{
+		printf("\x1B[31m[evg][readSlotTimes] Too many slots\n\x1B[0m");
+		return -1;
+	}
+	if (evg_readSlots(dev, sequencer, first, events, times ? timestamps : NULL, count) < 0)
+		return -1;
+
+	return times ? evg_fromTicks(dev, sequencer, unit, timestamps, times, count) : 0;
+}
+
+/**
+ * @brief	Programs a block of slots from times, writing only the slots that changed
+ *
+ * The times are converted and checked by evg_toTicks before anything is written, so a block
+ * that is rejected leaves the sequencer untouched. Times only have to increase within the block.
+ * See evg_applySlots.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be programmed
+ * @param	first		:	First address to program, the tables start with it
+ * @param	*events		:	Event codes, one per address, may be NULL
+ * @param	*times		:	Times, one per address, may be NULL
+ * @param	unit		:	Unit of the times
+ * @param	count		:	Number of addresses to program
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_applySlotTimes(void* dev, uint8_t sequencer, uint16_t first, const uint8_t *events, const double *times, timeunit_t unit, uint16_t count)
+{
+	uint32_t	timestamps[NUMBER_OF_ADDRESSES];
+
+	if (times && evg_toTicks(dev, sequencer, unit, times, timestamps, count) < 0)
+	{
+		printf("\x1B[31m[evg][applySlotTimes] Slots rejected, nothing written\n\x1B[0m");
+		return -1;
+	}
+
+	return evg_applySlots(dev, sequencer, first, events, times ? timestamps : NULL, count);
+}
+
+/**
+ * @brief	Sends a software event
+ *
+ * The event is written through the priority lane, without waiting for the device mutex,
+ * see urgent().
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	event	:	Event code
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setSoftwareEvent(void* dev, uint8_t event)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setSoftwareEvent] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Write software event*/
+	return urgent(device, REGISTER_SW_EVENT, event);
+}
+
+long
+evg_setCounterPrescaler(void* dev, uint8_t counter, uint32_t prescaler)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setCounterPrescaler] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+	if (counter >= NUMBER_OF_COUNTERS)
+	{
+		printf("\x1B[31m[evg][setCounterPrescaler] Invalid counter.\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	status	=	writeCounters(device, counter, &prescaler, 1);
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return status;
+}
+
+/**
+ * @brief	Sets the prescalers of all counters
+ *
+ * The prescalers are written and read back in one pipelined transfer, see writeCounters.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	*prescalers	:	Prescalers, one per counter
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setCounterPrescalers(void* dev, const uint32_t *prescalers)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !prescalers)
+	{
+		printf("\x1B[31m[evg][setCounterPrescalers] Null pointer to device or prescalers\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	status	=	writeCounters(device, 0, prescalers, NUMBER_OF_COUNTERS);
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return status;
+}
+
+
+long
+evg_getCounterPrescaler(void* dev, uint8_t counter, uint32_t *prescaler)
+{
+	uint16_t	data[COUNTER_WORDS]	=	{0};
+	uint32_t	word;
+	int32_t		status;
+	batch_t		batch;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+	if (counter >= NUMBER_OF_COUNTERS)
+	{
+		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+	if (!prescaler)
+	{
+		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Select each prescaler word and read it in one batch*/
+	batchInit(&batch);
+	for (word = 0; word < COUNTER_WORDS; word++)
+	{
+		batchAdd(&batch, ACCESS_WRITE, false, REGISTER_MXC_CONTROL, counter | counterWords[word].select, NULL);
+		batchAdd(&batch, ACCESS_READ, true, REGISTER_MXC_PRESCALER, 0, &data[word]);
+	}
+	status	=	batchRun(device, &batch);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+	*prescaler	=	0;
+	for (word = 0; word < COUNTER_WORDS; word++)
+		*prescaler	|=	(uint32_t)data[word] << counterWords[word].shift;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+
+long
+evg_getFirmwareVersion(void* dev, uint16_t *version)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !version)
+	{
+		printf("\x1B[31m[evg][enable] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Serve from the shadow copy without the mutex*/
+	if (peekreg(device, REGISTER_FIRMWARE, version))
+		return 0;
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Read version*/
+	status	=	readreg(device, REGISTER_FIRMWARE, version);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31msetAcPrescaler is unsuccessful\n\x1B[0m");
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Reloads the shadow copy of the register map from the device
+ *
+ * Registers only changed by the IOC are served from a shadow copy that is updated by every
+ * acknowledged access. This function rereads them all in one transfer, to catch changes
+ * made behind the IOC's back, without invalidating the shadow copy first, see refresh().
+ * The worker also calls it every SHADOW_PERIOD seconds while idle.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_refresh(void* dev)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][refresh] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	status	=	refresh(device);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][refresh] Couldn't read registers of %s\n\x1B[0m", device->name);
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Saves the whole state of a device to a snapshot file
+ *
+ * Reads the plain registers and the counter prescalers in one pipelined transfer, then the RAM of
+ * both sequencers, and writes them to a binary file, see snapshot_t. The device is locked throughout,
+ * so that the snapshot is consistent.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	*path	:	Path of the snapshot file, replaced if it exists
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_snapshot(void* dev, const char *path)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	j;
+	uint16_t	firmware;
+	uint16_t	registers[SNAPSHOT_REGISTERS];
+	uint32_t	counters[NUMBER_OF_COUNTERS];
+	uint8_t		*events;
+	uint32_t	*timestamps;
+	snapshot_t	*snapshot;
+	FILE		*file;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !path)
+	{
+		printf("\x1B[31m[evg][snapshot] Null pointer to device or path\n\x1B[0m");
+		return -1;
+	}
+
+	snapshot	=	calloc(1, sizeof(snapshot_t));
+	events		=	malloc(NUMBER_OF_SEQUENCERS * NUMBER_OF_ADDRESSES * sizeof(*events));
+	timestamps	=	malloc(NUMBER_OF_SEQUENCERS * NUMBER_OF_ADDRESSES * sizeof(*timestamps));
+	if (!snapshot || !events || !timestamps)
+	{
+		printf("\x1B[31m[evg][snapshot] Unable to allocate memory\n\x1B[0m");
+		free(snapshot);
+		free(events);
+		free(timestamps);
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Read the state*/
+	status	=	snapshotRead(device, &firmware, registers, counters);
+	for (i = 0; status == 0 && i < NUMBER_OF_SEQUENCERS; i++)
+		status	=	download(device, i, 0, events + i * NUMBER_OF_ADDRESSES, timestamps + i * NUMBER_OF_ADDRESSES, NUMBER_OF_ADDRESSES);
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][snapshot] Couldn't read the state of %s\n\x1B[0m", device->name);
+		free(snapshot);
+		free(events);
+		free(timestamps);
+		return -1;
+	}
+
+	/*Encode*/
+	memcpy(snapshot->magic, SNAPSHOT_MAGIC, sizeof(snapshot->magic));
+	snapshot->firmware	=	htons(firmware);
+	for (i = 0; i < SNAPSHOT_REGISTERS; i++)
+		snapshot->registers[i]	=	htons(registers[i]);
+	for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+		snapshot->counters[i]	=	htonl(counters[i]);
+	for (i = 0; i < NUMBER_OF_SEQUENCERS; i++)
+	{
+		for (j = 0; j < NUMBER_OF_ADDRESSES; j++)
+		{
+			snapshot->slots[i][j].event		=	events[i * NUMBER_OF_ADDRESSES + j];
+			snapshot->slots[i][j].timestamp	=	htonl(timestamps[i * NUMBER_OF_ADDRESSES + j]);
+		}
+	}
+	free(events);
+	free(timestamps);
+
+	/*Write file*/
+	file	=	fopen(path, "wb");
+	if (!file)
+	{
+		printf("\x1B[31m[evg][snapshot] Unable to open %s\n\x1B[0m", path);
+		free(snapshot);
+		return -1;
+	}
+	status	=	fwrite(snapshot, sizeof(snapshot_t), 1, file) == 1 ? 0 : -1;
+	if (fclose(file) != 0)
+		status	=	-1;
+	free(snapshot);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][snapshot] Unable to write %s\n\x1B[0m", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Restores the state of a device from a snapshot file
+ *
+ * Reads the current state of the device first, the same way evg_snapshot does, and only writes
+ * what differs from the snapshot: the slots of the sequencer RAM in delta mode, then the counter
+ * prescalers and the plain registers in one pipelined transfer, the control register last.
+ * Unless the device is under VERIFY_NEVER, the registers and counters are then read back.
+ * Meant for recovering a device that was power-cycled, the snapshot may be taken on any
+ * device of the same firmware.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	*path	:	Path of the snapshot file
+ * @return	0 on success, -1 on failure or mismatch
+ */
+long
+evg_restore(void* dev, const char *path)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	j;
+	uint32_t	n			=	0;
+	uint32_t	slots		=	0;
+	uint32_t	changed		=	0;
+	uint16_t	firmware;
+	uint16_t	registers[SNAPSHOT_REGISTERS];
+	uint16_t	current[SNAPSHOT_REGISTERS];
+	uint32_t	counters[NUMBER_OF_COUNTERS];
+	uint32_t	currentCounters[NUMBER_OF_COUNTERS];
+	uint8_t		*events;
+	uint32_t	*timestamps;
+	snapshot_t	*snapshot;
+	access_t	writes[SNAPSHOT_REGISTERS + 4 * NUMBER_OF_COUNTERS];
+	FILE		*file;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !path)
+	{
+		printf("\x1B[31m[evg][restore] Null pointer to device or path\n\x1B[0m");
+		return -1;
+	}
+
+	snapshot	=	malloc(sizeof(snapshot_t));
+	/*Tables of the snapshot, followed by the tables read from the device*/
+	events		=	malloc(2 * NUMBER_OF_ADDRESSES * sizeof(*events));
+	timestamps	=	malloc(2 * NUMBER_OF_ADDRESSES * sizeof(*timestamps));
+	if (!snapshot || !events || !timestamps)
+	{
+		printf("\x1B[31m[evg][restore] Unable to allocate memory\n\x1B[0m");
+		free(snapshot);
+		free(events);
+		free(timestamps);
+		return -1;
+	}
+
+	/*Read file*/
+	file	=	fopen(path, "rb");
+	if (!file)
+	{
+		printf("\x1B[31m[evg][restore] Unable to open %s\n\x1B[0m", path);
+		free(snapshot);
+		free(events);
+		free(timestamps);
+		return -1;
+	}
+	status	=	fread(snapshot, sizeof(snapshot_t), 1, file) == 1 && fgetc(file) == EOF ? 0 : -1;
+	fclose(file);
+	if (status < 0 || memcmp(snapshot->magic, SNAPSHOT_MAGIC, sizeof(snapshot->magic)) != 0)
+	{
+		printf("\x1B[31m[evg][restore] %s is not a snapshot\n\x1B[0m", path);
+		free(snapshot);
+		free(events);
+		free(timestamps);
+		return -1;
+	}
+	for (i = 0; i < SNAPSHOT_REGISTERS; i++)
+		registers[i]	=	ntohs(snapshot->registers[i]);
+	for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+		counters[i]		=	ntohl(snapshot->counters[i]);
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Read the current state*/
+	status	=	snapshotRead(device, &firmware, current, currentCounters);
+	if (status == 0 && firmware != ntohs(snapshot->firmware))
+		printf("\x1B[31m[evg][restore] %s was taken on firmware 0x%04x, %s runs 0x%04x\n\x1B[0m", path, ntohs(snapshot->firmware), device->name, firmware);
+
+	/*Write the slots that differ, the download refreshes the image the delta is taken against*/
+	for (i = 0; status == 0 && i < NUMBER_OF_SEQUENCERS; i++)
+	{
+		status	=	download(device, i, 0, events + NUMBER_OF_ADDRESSES, timestamps + NUMBER_OF_ADDRESSES, NUMBER_OF_ADDRESSES);
+		if (status < 0)
+			break;
+		for (j = 0; j < NUMBER_OF_ADDRESSES; j++)
+		{
+			events[j]		=	snapshot->slots[i][j].event;
+			timestamps[j]	=	ntohl(snapshot->slots[i][j].timestamp);
+			slots			+=	events[j] != events[NUMBER_OF_ADDRESSES + j] || timestamps[j] != timestamps[NUMBER_OF_ADDRESSES + j];
+		}
+		status	=	upload(device, i, 0, events, timestamps, NUMBER_OF_ADDRESSES, true);
+	}
+
+	/*Write the counters and registers that differ*/
+	for (i = 0; status == 0 && i < NUMBER_OF_COUNTERS; i++)
+	{
+		if (counters[i] == currentCounters[i])
+			continue;
+		changed++;
+		for (j = 0; j < COUNTER_WORDS; j++)
+		{
+			writes[n++]	=	(access_t){ACCESS_WRITE, false, REGISTER_MXC_CONTROL, i | counterWords[j].select};
+			writes[n++]	=	(access_t){ACCESS_WRITE, true, REGISTER_MXC_PRESCALER, counters[i] >> counterWords[j].shift};
+		}
+	}
+	for (i = 0; status == 0 && i < SNAPSHOT_REGISTERS; i++)
+	{
+		if (registers[i] == current[i])
+			continue;
+		changed++;
+		writes[n++]	=	(access_t){ACCESS_WRITE, false, snapshotRegisters[i], registers[i]};
+	}
+	if (status == 0 && n)
+		status	=	transfer(device, writes, n);
+
+	/*Read them back*/
+	if (status == 0 && n && device->verify != VERIFY_NEVER)
+	{
+		status	=	snapshotRead(device, &firmware, current, currentCounters);
+		if (status == 0 && (memcmp(current, registers, sizeof(current)) != 0 || memcmp(currentCounters, counters, sizeof(counters)) != 0))
+		{
+			printf("\x1B[31m[evg][restore] Registers of %s do not hold the snapshot\n\x1B[0m", device->name);
+			status	=	-1;
+		}
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	free(snapshot);
+	free(events);
+	free(timestamps);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][restore] Couldn't restore %s from %s\n\x1B[0m", device->name, path);
+		return -1;
+	}
+	printf("[evg][restore] %s: %u slots and %u registers differed from %s\n", device->name, slots, changed, path);
+
+	return 0;
+}
+
+/**
+ * @brief	Selects how writes of setters are verified
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	policy	:	VERIFY_ALWAYS, VERIFY_NEVER or VERIFY_DEFERRED
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setVerify(void* dev, verify_t policy)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setVerify] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+	if (policy != VERIFY_ALWAYS && policy != VERIFY_NEVER && policy != VERIFY_DEFERRED)
+	{
+		printf("\x1B[31m[evg][setVerify] Invalid policy\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Flush writes recorded under the previous policy*/
+	status	=	verify(device);
+	device->verify	=	policy;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return status;
+}
+
+/**
+ * @brief	Reads back the writes waiting for deferred verification
+ *
+ * The worker calls it when its queue drains, so deferred writes are verified shortly after
+ * a burst of record processing.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure or mismatch
+ */
+long
+evg_verify(void* dev)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][verify] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	status	=	verify(device);
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return status;
+}
+
+/**
+ * @brief	Reads a statistic of the device
+ *
+ * Supported statistics are transfers, failures, accesses, messages, datagrams, retries, timeouts,
+ * replies, stale, shortReads, coalesced, lockless, groups, gathered, resets, auditedSlots, slotMismatches, rttMean, rttMax, waitMean, waitMax, rto, srtt,
+ * laneWrites, laneAcks, laneUnconfirmed, laneRttMean, laneRttMax for the priority lane, in microseconds for latencies,
+ * requests, the number of record requests carried out by the worker, and imageHash0 and imageHash1,
+ * the rolling hash of the image of each sequencer folded to 32 bits.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	*name	:	Name of the statistic
+ * @param	*value	:	Value of the statistic
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_getStatistic(void* dev, const char *name, double *value)
+{
+	uint32_t	i;
+	stats_t		*stats;
+	lanestats_t	lane;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !name || !value)
+	{
+		printf("\x1B[31m[evg][getStatistic] Null pointer to device, name or value\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+	stats	=	&device->stats;
+	pthread_mutex_lock(&device->laneMutex);
+	lane	=	device->laneStats;
+	pthread_mutex_unlock(&device->laneMutex);
+
+	/*Act*/
+	if (strcmp(name, "transfers") == 0)
+		*value	=	stats->transfers;
+	else if (strcmp(name, "failures") == 0)
+		*value	=	stats->failures;
+	else if (strcmp(name, "accesses") == 0)
+		*value	=	stats->accesses;
+	else if (strcmp(name, "messages") == 0)
+		*value	=	stats->messages;
+	else if (strcmp(name, "datagrams") == 0)
+		*value	=	stats->datagrams;
+	else if (strcmp(name, "retries") == 0)
+		*value	=	stats->retries;
+	else if (strcmp(name, "timeouts") == 0)
+		*value	=	stats->timeouts;
+	else if (strcmp(name, "replies") == 0)
+		*value	=	stats->replies;
+	else if (strcmp(name, "stale") == 0)
+		*value	=	stats->stale;
+	else if (strcmp(name, "shortReads") == 0)
+		*value	=	stats->shortReads;
+	else if (strcmp(name, "coalesced") == 0)
+		*value	=	stats->coalesced;
+	else if (strcmp(name, "lockless") == 0)
+		*value	=	stats->lockless;
+	else if (strcmp(name, "groups") == 0)
+		*value	=	stats->groups;
+	else if (strcmp(name, "gathered") == 0)
+		*value	=	stats->gathered;
+	else if (strcmp(name, "resets") == 0)
+		*value	=	stats->resets;
+	else if (strcmp(name, "auditedSlots") == 0)
+		*value	=	stats->auditedSlots;
+	else if (strcmp(name, "slotMismatches") == 0)
+		*value	=	stats->slotMismatches;
+	else if (strcmp(name, "imageHash0") == 0 || strcmp(name, "imageHash1") == 0)
+		*value	=	(uint32_t)(device->imageHash[name[9] - '0'] ^ (device->imageHash[name[9] - '0'] >> 32));
+	else if (strcmp(name, "laneWrites") == 0)
+		*value	=	lane.writes;
+	else if (strcmp(name, "laneAcks") == 0)
+		*value	=	lane.acks;
+	else if (strcmp(name, "laneUnconfirmed") == 0)
+		*value	=	lane.unconfirmed;
+	else if (strcmp(name, "laneRttMean") == 0)
+		*value	=	lane.rtt.count ? (double)lane.rtt.sum / lane.rtt.count : 0;
+	else if (strcmp(name, "laneRttMax") == 0)
+		*value	=	lane.rtt.max;
+	else if (strcmp(name, "rttMean") == 0)
+		*value	=	stats->rtt.count ? (double)stats->rtt.sum / stats->rtt.count : 0;
+	else if (strcmp(name, "rttMax") == 0)
+		*value	=	stats->rtt.max;
+	else if (strcmp(name, "waitMean") == 0)
+		*value	=	stats->wait.count ? (double)stats->wait.sum / stats->wait.count : 0;
+	else if (strcmp(name, "waitMax") == 0)
+		*value	=	stats->wait.max;
+	else if (strcmp(name, "rto") == 0)
+		*value	=	device->rto;
+	else if (strcmp(name, "srtt") == 0)
+		*value	=	device->srtt;
+	else if (strcmp(name, "requests") == 0)
+	{
+		*value	=	0;
+		for (i = 0; i < stats->commandCount; i++)
+			*value	+=	stats->requests[i];
+	}
+	else
+	{
+		printf("\x1B[31m[evg][getStatistic] Unknown statistic %s\n\x1B[0m", name);
+		pthread_mutex_unlock(&device->mutex);
+		return -1;
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Clears the statistics of the device
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_resetStatistics(void* dev)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][resetStatistics] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	memset(&device->stats, 0, sizeof(device->stats));
+	pthread_mutex_lock(&device->laneMutex);
+	memset(&device->laneStats, 0, sizeof(device->laneStats));
+	pthread_mutex_unlock(&device->laneMutex);
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Bounds the adaptive retransmission timeout of the device
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	floor	:	Lower bound of the timeout in milliseconds
+ * @param	ceiling	:	Upper bound of the timeout in milliseconds
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setTimeout(void* dev, uint32_t floor, uint32_t ceiling)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setTimeout] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+	if (!floor || floor > ceiling || ceiling > UINT32_MAX / 1000)
+	{
+		printf("\x1B[31m[evg][setTimeout] Invalid timeout bounds\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	device->rtoFloor	=	floor * 1000;
+	device->rtoCeiling	=	ceiling * 1000;
+	if (device->rto < device->rtoFloor)
+		device->rto	=	device->rtoFloor;
+	if (device->rto > device->rtoCeiling)
+		device->rto	=	device->rtoCeiling;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Returns the I/O Intr scan list of a command
+ *
+ * Records reading the same registers share a scan list. The poller reads the registers of all
+ * scan lists in one transfer per period, and posts the lists whose registers changed.
+ * The records then read the fresh value from the shadow copy, without touching the network.
+ * Only commands backed by shadowed registers support I/O Intr scanning.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	*command	:	Command of the record
+ * @param	sequencer	:	Sequencer of the record
+ * @param	*scan		:	Scan list of the record
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_getIoScan(void* dev, const char *command, uint8_t sequencer, IOSCANPVT *scan)
+{
+	uint32_t	i;
+	uint64_t	registers	=	0;
+	device_t	*device		=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !command || !scan)
+	{
+		printf("\x1B[31m[evg][getIoScan] Null pointer to device, command or scan\n\x1B[0m");
+		return -1;
+	}
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
+	{
+		printf("\x1B[31m[evg][getIoScan] Invalid sequencer\n\x1B[0m");
+		return -1;
+	}
+	for (i = 0; i < sizeof(pollable) / sizeof(pollable[0]); i++)
+		if (strcmp(pollable[i].command, command) == 0)
+			registers	=	pollable[i].registers[sequencer];
+	if (!registers)
+	{
+		printf("\x1B[31m[evg][getIoScan] %s does not support I/O Intr scanning\n\x1B[0m", command);
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Find or create the scan list*/
+	for (i = 0; i < device->scanCount; i++)
+		if (device->scans[i].registers == registers)
+			break;
+	if (i >= device->scanCount)
+	{
+		if (device->scanCount >= NUMBER_OF_SCANS)
+		{
+			printf("\x1B[31m[evg][getIoScan] Too many scan lists\n\x1B[0m");
+			pthread_mutex_unlock(&device->mutex);
+			return -1;
+		}
+		device->scans[i].registers	=	registers;
+		scanIoInit(&device->scans[i].scan);
+		device->scanCount++;
+	}
+	*scan	=	device->scans[i].scan;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Sets the period of the I/O Intr poller
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	period	:	Period in milliseconds
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setPollPeriod(void* dev, uint32_t period)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setPollPeriod] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+	if (!period)
+	{
+		printf("\x1B[31m[evg][setPollPeriod] Invalid period\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	device->pollPeriod	=	period;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Sets the age below which a register read is shared by later requesters
+ *
+ * Reads carried out while a requester waits for the device are always shared with it.
+ * A non-zero age also shares reads carried out up to age milliseconds before the request,
+ * trading freshness for traffic at high scan rates. Shadowed registers are not affected.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	age		:	Age in milliseconds, 0 to disable
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setReadAge(void* dev, uint32_t age)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setReadAge] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	device->readAge	=	age;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Sets the time the worker gathers requests for before carrying them out together
+ *
+ * Record requests queued within the window of the oldest one are carried out as a group: their
+ * writes go out in one transfer and the records complete together, see worker. Gathering adds
+ * up to the window to the latency of each request, it is disabled by default.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	window	:	Gather window in microseconds, 0 to disable
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setGatherWindow(void* dev, uint32_t window)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setGatherWindow] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Act*/
+	pthread_mutex_lock(&device->requestMutex);
+	device->gatherWindow	=	window;
+	pthread_mutex_unlock(&device->requestMutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Sets the period of the background audit of the sequencer RAM
+ *
+ * Every period, the audit reads AUDIT_SLOTS slots back and compares them to the image,
+ * walking both sequencers in turn, see checkSlots. The audit is disabled by default.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	period	:	Period of the audit steps in milliseconds, 0 to disable
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setAuditPeriod(void* dev, uint32_t period)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setAuditPeriod] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	device->auditPeriod	=	period;
+	if (period && !device->auditing)
+	{
+		status	=	pthread_create(&device->auditor, NULL, auditor, device);
+		if (status)
+		{
+			printf("\x1B[31m[evg][setAuditPeriod] Unable to create audit thread\n\x1B[0m");
+			device->auditPeriod	=	0;
+			pthread_mutex_unlock(&device->mutex);
+			return -1;
+		}
+		device->auditing	=	true;
+	}
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Sets the period of the heartbeat that detects device resets
+ *
+ * The heartbeat runs every HEARTBEAT_PERIOD milliseconds by default, see heartbeat().
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	period	:	Period of the heartbeat in milliseconds, 0 to disable
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_setHeartbeatPeriod(void* dev, uint32_t period)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][setHeartbeatPeriod] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	/*Act*/
+	device->heartbeatPeriod	=	period;
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Starts a batch of register accesses
+ *
+ * Locks the device until the batch is committed. Accesses added to the batch are packed
+ * into as few datagrams as the device supports and are carried out in order by evg_batchCommit.
+ * Each access is retransmitted on its own, so the batch must not rely on registers that
+ * select the target of other registers (use the dedicated functions for those).
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_batchBegin(void* dev)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][batchBegin] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+
+	/*Lock mutex*/
+	lock(device);
+
+	batchInit(&device->batch);
+	device->batching	=	true;
+
+	return 0;
+}
+
+/**
+ * @brief	Adds a register read to the current batch
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	reg		:	Address of register to be read
+ * @param	*data	:	Location where the data is stored when the batch is committed
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_batchRead(void* dev, evgregister_t reg, uint16_t *data)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !data)
+	{
+		printf("\x1B[31m[evg][batchRead] Null pointer to device or data\n\x1B[0m");
+		return -1;
+	}
+	if (!device->batching)
+	{
+		printf("\x1B[31m[evg][batchRead] No batch was started\n\x1B[0m");
+		return -1;
+	}
+
+	return batchAdd(&device->batch, ACCESS_READ, false, reg, 0, data);
+}
+
+/**
+ * @brief	Adds a register write to the current batch
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	reg		:	Address of register to be written
+ * @param	data	:	16-bit data to be written
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_batchWrite(void* dev, evgregister_t reg, uint16_t data)
+{
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][batchWrite] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+	if (!device->batching)
+	{
+		printf("\x1B[31m[evg][batchWrite] No batch was started\n\x1B[0m");
+		return -1;
+	}
+
+	return batchAdd(&device->batch, ACCESS_WRITE, false, reg, data, NULL);
+}
+
+/**
+ * @brief	Carries out the current batch and unlocks the device
+ *
+ * Read data is scattered back to the locations given to evg_batchRead.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_batchCommit(void* dev)
+{
+	int32_t		status;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+	{
+		printf("\x1B[31m[evg][batchCommit] Null pointer to device\n\x1B[0m");
+		return -1;
+	}
+	if (!device->batching)
+	{
+		printf("\x1B[31m[evg][batchCommit] No batch was started\n\x1B[0m");
+		return -1;
+	}
+
+	/*Act*/
+	status				=	batchRun(device, &device->batch);
+	device->batching	=	false;
+	if (status < 0)
+		printf("\x1B[31m[evg][batchCommit] Couldn't carry out batch\n\x1B[0m");
+
+	/*Unlock mutex*/
+	pthread_mutex_unlock(&device->mutex);
+
+	return status;
+}
+
+/**
+ * @brief	Writes device's 16-bit register and checks the register was written
+ *
+ * Checks the write according to the verification policy of the device:
+ *	VERIFY_ALWAYS sends the write and a read of the same register in one pipelined transfer.
+ *	VERIFY_NEVER only relies on the acknowledgement of the write.
+ *	VERIFY_DEFERRED records the write, and all recorded writes are read back in one pass later on.
+ *	Registers selected through another register are still verified on the spot.
+ * The readback always comes from the device, never from the shadow copy.
+ * While the worker carries out a group of requests, the write and its readback are gathered
+ * instead, and go out with those of the other requests of the group, see gatherFlush. A later write
+ * of a gathered register replaces the gathered write. Indexed and selector registers are never gathered.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	reg		:	Address of register to be written
+ * @param	data	:	16-bit data to be written to device
+ * @return	0 on success, -1 on failure
+ */
+static long	
+writecheck(void *dev, evgregister_t reg, uint16_t data)
+{
+	int32_t		status;
+	uint32_t	i;
+	access_t	accesses[2];
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+		return -1;
+
+	/*Gather the write with those of the group*/
+	if (device->gathering && pthread_equal(pthread_self(), device->worker) && !((INDEXED_REGISTERS | SELECTOR_REGISTERS) & REGISTER_BIT(reg)))
+	{
+		/*A later write of the same register replaces the gathered one*/
+		if (device->gatherMask & REGISTER_BIT(reg))
+		{
+			for (i = 0; i < device->gatherCount; i++)
+			{
+				if (device->gather[i].reg != reg)
+					continue;
+				if (device->gather[i].access == ACCESS_WRITE)
+					device->gather[i].data		=	data;
+				else
+					device->gatherExpected[i]	=	data;
+				device->gatherOwner[i]	=	GATHER_REQUESTS;
+			}
+			if (device->verify == VERIFY_DEFERRED)
+				device->expected[(reg >> 1) % REGISTER_COUNT]	=	data;
+			device->stats.gathered++;
+			return 0;
+		}
+
+		if (device->gatherCount + 2 > GATHER_LENGTH)
+			gatherFlush(device);
+		device->gatherOwner[device->gatherCount]	=	device->gatherCurrent;
+		device->gather[device->gatherCount++]		=	(access_t){ACCESS_WRITE, false, reg, data};
+		if (device->verify == VERIFY_ALWAYS)
+		{
+			device->gatherOwner[device->gatherCount]	=	device->gatherCurrent;
+			device->gatherExpected[device->gatherCount]	=	data;
+			device->gather[device->gatherCount++]		=	(access_t){ACCESS_READ, false, reg, 0x0000};
+		}
+		else if (device->verify == VERIFY_DEFERRED)
+		{
+			device->expected[(reg >> 1) % REGISTER_COUNT]	=	data;
+			device->unverified	|=	REGISTER_BIT(reg);
+		}
+		device->gatherMask	|=	REGISTER_BIT(reg);
+		device->stats.gathered++;
+		return 0;
+	}
+
+	/*Write without readback*/
+	if (device->verify == VERIFY_NEVER)
+		return writereg(device, reg, data);
+	if (device->verify == VERIFY_DEFERRED && !(INDEXED_REGISTERS & REGISTER_BIT(reg)))
+	{
+		status	=	writereg(device, reg, data);
+		if (status < 0)
+			return -1;
+		device->expected[(reg >> 1) % REGISTER_COUNT]	=	data;
+		device->unverified	|=	REGISTER_BIT(reg);
+		return 0;
+	}
+
+	/*Prepare accesses*/
+	accesses[0]	=	(access_t){ACCESS_WRITE, false, reg, data};
+	accesses[1]	=	(access_t){ACCESS_READ, false, reg, 0x0000};
+
+	/*Write data and read it back*/
+	status	=	transfer(dev, accesses, 2);
+	if (status < 0)
+		return -1;
+
+	/*Check that data was updated*/
+	if (accesses[1].data != data)
+		return -1;
+
+	return 0;
+}
+
+/**
+ * @brief	Carries out the gathered accesses
+ *
+ * Sends the gathered writes and readbacks in one transfer. The requests owning accesses that
+ * failed, or whose readback does not match, are marked failed. Accesses written by several
+ * requests fail the whole group.
+ * Must be called with the device mutex held.
+ *
+ * @param	*device	:	Device whose accesses were gathered
+ * @return	0 on success, -1 on failure
+ */
+static long
+gatherFlush(device_t *device)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	mismatches	=	0;
+	uint32_t	count		=	device->gatherCount;
+
+	if (!count)
+		return 0;
+	device->gatherCount	=	0;
+	device->gatherMask	=	0;
+
+	status	=	transfer(device, device->gather, count);
+	for (i = 0; i < count; i++)
+	{
+		if (status >= 0 && (device->gather[i].access != ACCESS_READ || device->gather[i].data == device->gatherExpected[i]))
+			continue;
+		if (status >= 0)
+		{
+			printf("\x1B[31m[evg][gatherFlush] %s: register 0x%02x holds 0x%04x, 0x%04x was written\n\x1B[0m", device->name, device->gather[i].reg, device->gather[i].data, device->gatherExpected[i]);
+			mismatches++;
+		}
+		if (device->gatherOwner[i] < GATHER_REQUESTS)
+			device->gatherFailed[device->gatherOwner[i]]	=	true;
+		else
+			memset(device->gatherFailed, true, sizeof(device->gatherFailed));
+	}
+
+	return status < 0 || mismatches ? -1 : 0;
+}
+
+/**
+ * @brief	Reads 16-bit register from device
+ *
+ * Serves the register from the gathered write of it, if any, or from the shadow copy when it holds a valid value.
+ * Otherwise shares the last read of the register if it was sent after the caller asked for the
+ * device, i.e. while the caller was waiting for the mutex, or if it is younger than device->readAge.
+ * Failing both, prepares a single read access and carries it out through the transport.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	reg		:	Address of register to be read
+ * @param	*data	:	16-bit data read from register
+ * @return	0 on success, -1 on failure
+ */
+static long
+readreg(void *dev, evgregister_t reg, uint16_t *data)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint64_t	sent;
+	access_t	access;
+	device_t	*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !data)
+		return -1;
+
+	/*Serve a gathered write of a shadowed register, carry out others first*/
+	if (device->gatherMask & REGISTER_BIT(reg))
+	{
+		for (i = 0; SHADOW_REGISTERS & REGISTER_BIT(reg) && i < device->gatherCount; i++)
+		{
+			if (device->gather[i].access == ACCESS_WRITE && device->gather[i].reg == reg)
+			{
+				*data	=	device->gather[i].data;
+				return 0;
+			}
+		}
+		gatherFlush(device);
+	}
+
+	/*Serve from the shadow copy*/
+	if (device->shadowValid & SHADOW_REGISTERS & REGISTER_BIT(reg))
+	{
+		*data	=	device->shadow[(reg >> 1) % REGISTER_COUNT];
+		return 0;
+	}
+
+	/*Share a read carried out for another requester*/
+	sent	=	device->recentTime[(reg >> 1) % REGISTER_COUNT];
+	if (sent && (sent >= device->arrival || (device->readAge && now() - sent <= device->readAge * 1000ULL)))
+	{
+		*data	=	device->recent[(reg >> 1) % REGISTER_COUNT];
+		device->stats.coalesced++;
+		return 0;
+	}
+
+	/*Prepare access*/
+	access.access	=	ACCESS_READ;
+	access.chained	=	false;
+	access.reg		=	reg;
+	access.data		=	0x0000;
+
+	status	=	transfer(dev, &access, 1);
+	if (status < 0)
+		return -1;
+
+	/*Extract data*/
+	*data	=	access.data;
+
+	return 0;
+}
+
+/**
+ * @brief	Reads a shadowed register without taking the device mutex
+ *
+ * The shadow copy is a seqlock: writers, which hold the mutex, make shadowSequence odd while they
+ * update it, see shadowBegin and shadowEnd. A reader copies the register and keeps the copy only
+ * if the sequence was even and did not change meanwhile, so it never waits for a transfer in
+ * progress. Registers that are not shadowed, not valid, or written by a gathered access are left
+ * to readreg, under the mutex.
+ *
+ * @param	*device	:	A pointer to the device being acted upon
+ * @param	reg		:	Address of register to be read
+ * @param	*data	:	16-bit data read from the shadow copy
+ * @return	true if the register was served, false if it must be read under the mutex
+ */
+static bool
+peekreg(device_t *device, evgregister_t reg, uint16_t *data)
+{
+	uint32_t	attempt;
+	uint32_t	sequence;
+	uint64_t	valid;
+	uint64_t	gathered;
+	uint16_t	value;
+
+	if (!(SHADOW_REGISTERS & REGISTER_BIT(reg)))
+		return false;
+
+	for (attempt = 0; attempt < PEEK_ATTEMPTS; attempt++)
+	{
+		sequence	=	__atomic_load_n(&device->shadowSequence, __ATOMIC_ACQUIRE);
+		if (sequence & 1)
+		{
+			sched_yield();
+			continue;
+		}
+		valid		=	__atomic_load_n(&device->shadowValid, __ATOMIC_RELAXED);
+		gathered	=	__atomic_load_n(&device->gatherMask, __ATOMIC_RELAXED);
+		value		=	__atomic_load_n(&device->shadow[(reg >> 1) % REGISTER_COUNT], __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&device->shadowSequence, __ATOMIC_RELAXED) != sequence)
+			continue;
+
+		if (!(valid & REGISTER_BIT(reg)) || (gathered & REGISTER_BIT(reg)))
+			return false;
+		*data	=	value;
+		__atomic_fetch_add(&device->stats.lockless, 1, __ATOMIC_RELAXED);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief	Starts an update of the shadow copy, with the device mutex held
+ *
+ * @param	*device	:	A pointer to the device being acted upon
+ */
+static void
+shadowBegin(device_t *device)
+{
+	__atomic_store_n(&device->shadowSequence, device->shadowSequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief	Ends an update of the shadow copy, with the device mutex held
+ *
+ * @param	*device	:	A pointer to the device being acted upon
+ */
+static void
+shadowEnd(device_t *device)
+{
+	__atomic_store_n(&device->shadowSequence, device->shadowSequence + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief	Returns the number of ticks of the sequencer clock per unit of time
+ *
+ * The sequencer counts ticks of the event clock divided by its prescaler. Both are taken from the
+ * shadow copy without the mutex, see peekreg. The event frequency falls back to the configured one,
+ * and the prescaler is only read from the device when it is not cached. A prescaler of 0 counts as 1.
+ *
+ * @param	*device		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer whose clock is converted to
+ * @param	unit		:	Unit of time
+ * @param	*rate		:	Ticks per unit of time
+ * @return	0 on success, -1 on failure
+ */
+static long
+tickRate(device_t *device, uint8_t sequencer, timeunit_t unit, double *rate)
+{
+	uint16_t	frequency;
+	uint16_t	prescaler;
+
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
+	{
+		printf("\x1B[31m[evg][tickRate] Invalid sequencer\n\x1B[0m");
+		return -1;
+	}
+	if (unit > TIME_MICROSECONDS)
+	{
+		printf("\x1B[31m[evg][tickRate] Invalid unit of time\n\x1B[0m");
+		return -1;
+	}
+	if (unit == TIME_TICKS)
+	{
+		*rate	=	1;
+		return 0;
+	}
+
+	if (!peekreg(device, REGISTER_USEC_DIVIDER, &frequency) || !frequency)
+		frequency	=	device->frequency;
+	if (evg_getSequencerPrescaler(device, sequencer, &prescaler) < 0)
+		return -1;
+	if (!frequency)
+	{
+		printf("\x1B[31m[evg][tickRate] Unknown event frequency\n\x1B[0m");
+		return -1;
+	}
+
+	*rate	=	(double)frequency / (prescaler ? prescaler : 1);
+	if (unit == TIME_NANOSECONDS)
+		*rate	/=	1000;
+
+	return 0;
+}
+
+/**
+ * @brief	Writes device's 16-bit register
+ *
+ * Prepares a single write access and carries it out through the transport.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	reg		:	Address of register to be read
+ * @param	data	:	16-bit data to be written to device
+ * @return	0 on success, -1 on failure
+ */
+static long
+writereg(void *dev, evgregister_t reg, uint16_t data)
+{
+	access_t	access;
+
+	if (!dev)
+		return -1;
+
+	/*Prepare access*/
+	access.access	=	ACCESS_WRITE;
+	access.chained	=	false;
+	access.reg		=	reg;
+	access.data		=	data;
+
+	return transfer(dev, &access, 1);
+}
+
+/**
+ * @brief	Reads the shadowed registers from the device
+ *
+ * Reads every shadowed register in one transfer. The values held so far stay valid meanwhile:
+ * the transport overwrites each of them as its read is acknowledged, and only invalidates
+ * the registers whose read failed, see transferShadow.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure
+ */
+static long
+refresh(void *dev)
+{
+	uint32_t	i;
+	uint32_t	count	=	0;
+	access_t	accesses[REGISTER_COUNT];
+	device_t	*device	=	(device_t*)dev;
+
+	if (!dev)
+		return -1;
+
+	for (i = 0; i < REGISTER_COUNT; i++)
+		if (SHADOW_REGISTERS & (1ULL << i))
+			accesses[count++]	=	(access_t){ACCESS_READ, false, i << 1, 0x0000};
+
+	return transfer(device, accesses, count);
+}
+
+/**
+ * @brief	Reads back the writes waiting for deferred verification
+ *
+ * Reads every register written since the last pass in one transfer, and reports
+ * the registers that do not hold the data written to them.
+ * Then reads back the sequencer words written by deferred uploads, see checkSlots.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure or mismatch
+ */
+static long
+verify(void *dev)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	count		=	0;
+	uint32_t	mismatches	=	0;
+	uint8_t		sequencer;
+	access_t	accesses[REGISTER_COUNT];
+	device_t	*device		=	(device_t*)dev;
+
+	if (!dev)
+		return -1;
+
+	/*Sequencer words*/
+	for (sequencer = 0; sequencer < NUMBER_OF_SEQUENCERS; sequencer++)
+	{
+		if (!device->uncheckedSlots[sequencer])
+			continue;
+		device->uncheckedSlots[sequencer]	=	false;
+		status	=	checkSlots(device, sequencer, 0, NUMBER_OF_ADDRESSES, true);
+		if (status)
+			mismatches++;
+	}
+
+	/*Registers*/
+	if (!device->unverified)
+		return mismatches ? -1 : 0;
+	for (i = 0; i < REGISTER_COUNT; i++)
+		if (device->unverified & (1ULL << i))
+			accesses[count++]	=	(access_t){ACCESS_READ, false, i << 1, 0x0000};
+	device->unverified	=	0;
+
+	status	=	transfer(device, accesses, count);
+	if (status < 0)
+		return -1;
+
+	for (i = 0; i < count; i++)
+	{
+		if (accesses[i].data == device->expected[accesses[i].reg >> 1])
+			continue;
+		printf("\x1B[31m[evg][verify] %s: register 0x%02x holds 0x%04x, 0x%04x was written\n\x1B[0m", device->name, accesses[i].reg, accesses[i].data, device->expected[accesses[i].reg >> 1]);
+		mismatches++;
+	}
+
+	return mismatches ? -1 : 0;
+}
+
+/**
+ * @brief	Reads the plain registers and the counter prescalers of a snapshot
+ *
+ * Reads them in one pipelined transfer, each prescaler word being a chained group made of the
+ * counter selection and the read. The self-clearing bits of the control register are dropped.
+ * Must be called with the device mutex held.
+ *
+ * @param	*device		:	A pointer to the device being read
+ * @param	*firmware	:	Firmware version read
+ * @param	*registers	:	Registers read, in the order of snapshotRegisters
+ * @param	*counters	:	Counter prescalers read
+ * @return	0 on success, -1 on failure
+ */
+static long
+snapshotRead(device_t *device, uint16_t *firmware, uint16_t *registers, uint32_t *counters)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	word;
+	uint32_t	n	=	0;
+	access_t	reads[1 + SNAPSHOT_REGISTERS + 2 * COUNTER_WORDS * NUMBER_OF_COUNTERS];
+
+	reads[n++]	=	(access_t){ACCESS_READ, false, REGISTER_FIRMWARE, 0x0000};
+	for (i = 0; i < SNAPSHOT_REGISTERS; i++)
+		reads[n++]	=	(access_t){ACCESS_READ, false, snapshotRegisters[i], 0x0000};
+	for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+	{
+		for (word = 0; word < COUNTER_WORDS; word++)
+		{
+			reads[n++]	=	(access_t){ACCESS_WRITE, false, REGISTER_MXC_CONTROL, i | counterWords[word].select};
+			reads[n++]	=	(access_t){ACCESS_READ, true, REGISTER_MXC_PRESCALER, 0x0000};
+		}
+	}
+	status	=	transfer(device, reads, n);
+	if (status < 0)
+		return -1;
+
+	*firmware	=	reads[0].data;
+	for (i = 0; i < SNAPSHOT_REGISTERS; i++)
+	{
+		registers[i]	=	reads[1 + i].data;
+		if (snapshotRegisters[i] == REGISTER_CONTROL)
+			registers[i]	&=	~SHADOW_CONTROL_VOLATILE;
+	}
+	for (i = 0, n = 1 + SNAPSHOT_REGISTERS; i < NUMBER_OF_COUNTERS; i++)
+	{
+		counters[i]	=	0;
+		for (word = 0; word < COUNTER_WORDS; word++, n += 2)
+			counters[i]	|=	(uint32_t)reads[n + 1].data << counterWords[word].shift;
+	}
+
+	return 0;
+}
+/**
+ * @brief	Writes counter prescalers and reads them back
+ *
+ * Each word of a prescaler is a chained group made of the word select, the write, and its readback,
+ * and all counters go out in one batch.
+ * Must be called with the device mutex held.
+ *
+ * @param	*device		:	Device being acted upon
+ * @param	first		:	First counter to write, the table starts with it
+ * @param	*prescalers	:	Prescalers, one per counter
+ * @param	count		:	Number of counters to write
+ * @return	0 on success, -1 on failure
+ */
+static long
+writeCounters(device_t *device, uint8_t first, const uint32_t *prescalers, uint8_t count)
+{
+	uint16_t	readback[NUMBER_OF_COUNTERS][COUNTER_WORDS]	=	{{0}};
+	uint32_t	i;
+	uint32_t	word;
+	int32_t		status;
+	batch_t		batch;
+
+	if (first + count > NUMBER_OF_COUNTERS)
+		return -1;
+
+	/*Select each prescaler word, write it and read it back*/
+	batchInit(&batch);
+	for (i = 0; i < count; i++)
+	{
+		for (word = 0; word < COUNTER_WORDS; word++)
+		{
+			batchAdd(&batch, ACCESS_WRITE, false, REGISTER_MXC_CONTROL, (first + i) | counterWords[word].select, NULL);
+			batchAdd(&batch, ACCESS_WRITE, true, REGISTER_MXC_PRESCALER, prescalers[i] >> counterWords[word].shift, NULL);
+			batchAdd(&batch, ACCESS_READ, true, REGISTER_MXC_PRESCALER, 0, &readback[i][word]);
+		}
+	}
+	status	=	batchRun(device, &batch);
+	if (status < 0)
+	{
+		errlogPrintf("\x1B[31m[evg][setCounterPrescaler] Couldn't write prescaler\n\x1B[0m");
+		return -1;
+	}
+	for (i = 0; i < count; i++)
+	{
+		for (word = 0; word < COUNTER_WORDS; word++)
+		{
+			if (readback[i][word] != (uint16_t)(prescalers[i] >> counterWords[word].shift))
+			{
+				errlogPrintf("\x1B[31m[evg][setCounterPrescaler] Readback mismatch on counter %u\n\x1B[0m", first + i);
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * @brief	Reads a table from the sequencer RAM
+ *
+ * Each slot read is a chained group made of the address write followed by reads of the words of the slot,
+ * and all slots are read in one transfer.
+ * Either table may be NULL, in which case that part of the slots is not read.
+ * Must be called with the device mutex held.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be read
+ * @param	first		:	First address to read, the tables start with it
+ * @param	*events		:	Event codes read, one per address
+ * @param	*timestamps	:	Timestamps read, one per address
+ * @param	count		:	Number of addresses to read
+ * @return	0 on success, -1 on failure
+ */
+static long
+download(void *dev, uint8_t sequencer, uint16_t first, uint8_t *events, uint32_t *timestamps, uint16_t count)
+{
+	int32_t			status;
+	uint32_t		n		=	0;
+	uint16_t		address;
+	const evgregister_t	*regs;
+	access_t		*reads;
+	access_t		*slot;
+	device_t		*device	=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev)
+		return -1;
+	if (sequencer >= NUMBER_OF_SEQUENCERS)
+	{
+		printf("\x1B[31m[evg][download] Invalid sequencer\n\x1B[0m");
+		return -1;
+	}
+	if (!events && !timestamps)
+	{
+		printf("\x1B[31m[evg][download] Null pointer to sequence\n\x1B[0m");
+		return -1;
+	}
+	if (first + count > NUMBER_OF_ADDRESSES)
+	{
+		printf("\x1B[31m[evg][download] Sequence is too long\n\x1B[0m");
+		return -1;
+	}
+	if (!count)
+		return 0;
+
+	regs	=	sequencerRegisters[sequencer].slot;
+
+	/*Prepare accesses*/
+	reads	=	malloc((SLOT_FIELDS + 1) * count * sizeof(access_t));
+	if (!reads)
+	{
+		printf("\x1B[31m[evg][download] Unable to allocate memory\n\x1B[0m");
+		return -1;
+	}
+	for (address = 0; address < count; address++)
+	{
+		reads[n++]	=	(access_t){ACCESS_WRITE, false, regs[0], first + address};
+		if (events)
+			reads[n++]	=	(access_t){ACCESS_READ, true, regs[1], 0x0000};
+		if (timestamps)
+		{
+			reads[n++]	=	(access_t){ACCESS_READ, true, regs[2], 0x0000};
+			reads[n++]	=	(access_t){ACCESS_READ, true, regs[3], 0x0000};
+		}
+	}
+
+	/*Read slots*/
+	status	=	transfer(device, reads, n);
+	if (status < 0)
+	{
+		free(reads);
+		return -1;
+	}
+
+	/*Extract data*/
+	for (address = 0, slot = reads; address < count; address++)
+	{
+		slot++;
+		if (events)
+			events[address]		=	(slot++)->data;
+		if (timestamps)
+		{
+			timestamps[address]	=	(uint32_t)slot[0].data << 16 | slot[1].data;
+			slot	+=	2;
+		}
+	}
+
+	free(reads);
+	return 0;
+}
+
+/**
+ * @brief	Estimates how long the sequence loaded in the sequencer runs
+ *
+ * Looks up the first EVENT_END_SEQUENCE in the sequencer image, and converts its timestamp
+ * to microseconds with the shadowed sequencer prescaler and the event frequency.
+ * When the end of the sequence is not known, COMMIT_DRAIN is returned.
+ * Must be called with the device mutex held.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer whose sequence is estimated
+ * @return	Time in microseconds, at most COMMIT_DRAIN_LIMIT
+ */
+static uint64_t
+runtime(void *dev, uint8_t sequencer)
+{
+	uint16_t		address;
+	uint16_t		*slot;
+	uint64_t		time		=	COMMIT_DRAIN;
+	uint64_t		prescaler	=	1;
+	device_t		*device		=	(device_t*)dev;
+	evgregister_t	selector	=	sequencerRegisters[sequencer].clock;
+
+	if (device->shadowValid & REGISTER_BIT(selector) && device->shadow[selector >> 1])
+		prescaler	=	device->shadow[selector >> 1];
+
+	for (address = 0; address < NUMBER_OF_ADDRESSES; address++)
+	{
+		if ((device->imageValid[sequencer][address] & 7) != 7)
+			break;
+		slot	=	device->image[sequencer][address];
+		if (slot[0] == EVENT_END_SEQUENCE)
+		{
+			time	=	(((uint64_t)slot[1] << 16 | slot[2]) * prescaler) / (device->frequency ? device->frequency : 1) + 1;
+			break;
+		}
+	}
+
+	return time < COMMIT_DRAIN_LIMIT ? time : COMMIT_DRAIN_LIMIT;
+}
+
+/**
+ * @brief	Waits for the commits draining the given sequencers to take the mutex back
+ *
+ * A commit lets go of the mutex while the running sequence ends, see evg_commitSequence.
+ * Whatever would write the RAM of that sequencer or its staging buffer, trigger it, or change
+ * the AC trigger gates in the meantime waits here instead, so that the commit finds things as it left them.
+ * Must be called with the device mutex held, which is released while waiting.
+ *
+ * @param	*device		:	A pointer to the device being acted upon
+ * @param	sequencers	:	Bitmask of the sequencers
+ */
+static void
+drainWait(device_t *device, uint8_t sequencers)
+{
+	while (device->draining & sequencers)
+		pthread_cond_wait(&device->drained, &device->mutex);
+}
+
+/**
+ * @brief	Writes a table to the sequencer RAM
+ *
+ * See uploadTables, which this calls with a single table.
+ * Must be called with the device mutex held.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be written
+ * @param	first		:	First address to write, the tables start with it
+ * @param	*events		:	Event codes, one per address
+ * @param	*timestamps	:	Timestamps, one per address
+ * @param	count		:	Number of addresses to write
+ * @param	delta		:	Only write what differs from the image
+ * @return	0 on success, -1 on failure
+ */
+static long
+upload(void *dev, uint8_t sequencer, uint16_t first, const uint8_t *events, const uint32_t *timestamps, uint16_t count, bool delta)
+{
+	slottable_t	table	=	{sequencer, first, events, timestamps, count};
+
+	return uploadTables(dev, &table, 1, delta);
+}
+
+/**
+ * @brief	Writes tables to the sequencer RAM in one transfer
+ *
+ * Each slot written is a chained group made of the address write followed by the words of the slot.
+ * The slots of the tables are interleaved, the n-th slot of each table one after the other, so that
+ * the sequencers are written side by side in the pipeline rather than one after the other.
+ * In delta mode, only the words that differ from the image of the sequencer RAM are written,
+ * and slots that are already up to date are skipped altogether.
+ * Either table of a slottable_t may be NULL, in which case that part of the slots is left untouched.
+ * Under VERIFY_ALWAYS, the words written are then read back in one pass. Under VERIFY_DEFERRED,
+ * they are only marked for verify() to read back once the worker is idle, see checkSlots.
+ * Must be called with the device mutex held.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	*tables		:	Tables to be written
+ * @param	count		:	Number of tables
+ * @param	delta		:	Only write what differs from the image
+ * @return	0 on success, -1 on failure
+ */
+static long
+uploadTables(void *dev, const slottable_t *tables, uint8_t count, bool delta)
+{
+	int32_t				status;
+	uint32_t			i;
+	uint32_t			n			=	0;
+	uint32_t			slots		=	0;
+	uint32_t			mismatches	=	0;
+	uint16_t			index;
+	uint16_t			address;
+	uint16_t			field;
+	uint16_t			changed;
+	uint16_t			longest		=	0;
+	uint16_t			words[SLOT_FIELDS];
+	uint8_t				sequencer;
+	uint8_t				sequencers	=	0;
+	const evgregister_t	*regs;
+	const slottable_t	*table;
+	access_t			*writes;
+	access_t			*reads;
+	device_t			*device		=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || !tables)
+		return -1;
+	for (table = tables; table < tables + count; table++)
+	{
+		if (table->sequencer >= NUMBER_OF_SEQUENCERS)
+		{
+			printf("\x1B[31m[evg][upload] Invalid sequencer\n\x1B[0m");
+			return -1;
+		}
+		if (!table->events && !table->timestamps)
+		{
+			printf("\x1B[31m[evg][upload] Null pointer to sequence\n\x1B[0m");
+			return -1;
+		}
+		if (table->first + table->count > NUMBER_OF_ADDRESSES)
+		{
+			printf("\x1B[31m[evg][upload] Sequence is too long\n\x1B[0m");
+			return -1;
+		}
+		slots	+=	table->count;
+		if (table->count > longest)
+			longest	=	table->count;
+	}
+	if (!slots)
+		return 0;
+
+	/*Keep off the sequencer RAM while a commit drains it*/
+	for (table = tables; table < tables + count; table++)
+		sequencers	|=	1 << table->sequencer;
+	drainWait(device, sequencers);
+
+	/*Prepare accesses, the readback pass mirrors the writes*/
+	writes	=	malloc(2 * (SLOT_FIELDS + 1) * slots * sizeof(access_t));
+	if (!writes)
+	{
+		printf("\x1B[31m[evg][upload] Unable to allocate memory\n\x1B[0m");
+		return -1;
+	}
+	reads	=	writes + (SLOT_FIELDS + 1) * slots;
+	for (index = 0; index < longest; index++)
+	{
+		for (table = tables; table < tables + count; table++)
+		{
+			if (index >= table->count)
+				continue;
+			sequencer	=	table->sequencer;
+			regs		=	sequencerRegisters[sequencer].slot;
+			address		=	table->first + index;
+			words[0]	=	table->events ? table->events[index] : 0;
+			words[1]	=	table->timestamps ? table->timestamps[index] >> 16 : 0;
+			words[2]	=	table->timestamps ? table->timestamps[index] : 0;
+
+			/*Find the words that need to be written*/
+			changed	=	0;
+			for (field = 0; field < SLOT_FIELDS; field++)
+				if (!delta || !(device->imageValid[sequencer][address] & (1 << field)) || device->image[sequencer][address][field] != words[field])
+					changed	|=	1 << field;
+			if (!table->events)
+				changed	&=	~1;
+			if (!table->timestamps)
+				changed	&=	~6;
+			if (!changed)
+				continue;
+
+			/*Select the slot and write them*/
+			writes[n++]	=	(access_t){ACCESS_WRITE, false, regs[0], address};
+			for (field = 0; field < SLOT_FIELDS; field++)
+				if (changed & (1 << field))
+					writes[n++]	=	(access_t){ACCESS_WRITE, true, regs[field + 1], words[field]};
+		}
+	}
+	if (!n)
+	{
+		free(writes);
+		return 0;
+	}
+
+	/*Write slots*/
+	status	=	transfer(device, writes, n);
+	if (status < 0)
+	{
+		free(writes);
+		return -1;
+	}
+
+	/*Mark the words written for deferred verification*/
+	if (device->verify == VERIFY_DEFERRED)
+	{
+		for (i = 0, address = 0; i < n; i++)
+		{
+			if (!writes[i].chained)
+				address	=	writes[i].data;
+			else
+			{
+				field	=	slotField(writes[i].reg, &sequencer);
+				device->unchecked[sequencer][address]	|=	1 << field;
+				device->uncheckedSlots[sequencer]		=	true;
+			}
+		}
+	}
+
+	/*Read the words written back*/
+	if (device->verify == VERIFY_ALWAYS)
+	{
+		for (i = 0; i < n; i++)
+		{
+			reads[i]	=	writes[i];
+			if (reads[i].chained)
+				reads[i].access	=	ACCESS_READ;
+		}
+		status	=	transfer(device, reads, n);
+		if (status < 0)
+		{
+			printf("\x1B[31m[evg][upload] Couldn't read sequence back\n\x1B[0m");
+			free(writes);
+			return -1;
+		}
+		for (i = 0, address = 0; i < n; i++)
+		{
+			if (!reads[i].chained)
+				address	=	reads[i].data;
+			else if (reads[i].data != writes[i].data)
+			{
+				slotField(reads[i].reg, &sequencer);
+				printf("\x1B[31m[evg][upload] Sequencer %u address %u register 0x%02x holds 0x%04x, 0x%04x was written\n\x1B[0m", sequencer, address, reads[i].reg, reads[i].data, writes[i].data);
+				mismatches++;
+			}
+		}
+	}
+
+	free(writes);
+	return mismatches ? -1 : 0;
+}
+
+
+/**
+ * @brief	Reads sequencer slots back and compares them to the image
+ *
+ * Reads the words of the slots first to first+count-1 in one pipelined transfer, each slot being a
+ * chained group of the address write and the reads. Only the valid words of the image are read,
+ * and among them, if unchecked is set, only the words marked by deferred uploads.
+ * The first mismatch is reported, and the image takes the value read from the device,
+ * so that the next delta upload rewrites the word.
+ * Must be called with the device mutex held.
+ *
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	sequencer	:	Sequencer to be checked
+ * @param	first		:	First slot to be checked
+ * @param	count		:	Number of slots to be checked
+ * @param	unchecked	:	Only check the words marked by deferred uploads, and unmark them
+ * @return	0 if the words match, 1 on mismatch, -1 on failure
+ */
+static long
+checkSlots(void *dev, uint8_t sequencer, uint16_t first, uint16_t count, bool unchecked)
+{
+	int32_t			status;
+	uint32_t		i;
+	uint32_t		n			=	0;
+	uint32_t		mismatches	=	0;
+	uint16_t		address;
+	uint16_t		field;
+	uint8_t			fields;
+	const evgregister_t	*regs;
+	uint16_t		*expected;
+	access_t		*reads;
+	device_t		*device		=	(device_t*)dev;
+
+	/*Check inputs*/
+	if (!dev || sequencer >= NUMBER_OF_SEQUENCERS || first + count > NUMBER_OF_ADDRESSES)
+		return -1;
+
+	regs	=	sequencerRegisters[sequencer].slot;
+
+	/*Prepare accesses*/
+	reads		=	malloc((SLOT_FIELDS + 1) * count * sizeof(access_t));
+	expected	=	malloc((SLOT_FIELDS + 1) * count * sizeof(uint16_t));
+	if (!reads || !expected)
+	{
+		printf("\x1B[31m[evg][checkSlots] Unable to allocate memory\n\x1B[0m");
+		free(reads);
+		free(expected);
+		return -1;
+	}
+	for (address = first; address < first + count; address++)
+	{
+		fields	=	device->imageValid[sequencer][address];
+		if (unchecked)
+		{
+			fields	&=	device->unchecked[sequencer][address];
+			device->unchecked[sequencer][address]	=	0;
+		}
+		if (!fields)
+			continue;
+
+		reads[n++]	=	(access_t){ACCESS_WRITE, false, regs[0], address};
+		for (field = 0; field < SLOT_FIELDS; field++)
+		{
+			if (!(fields & (1 << field)))
+				continue;
+			expected[n]	=	device->image[sequencer][address][field];
+			reads[n++]	=	(access_t){ACCESS_READ, true, regs[field + 1], 0x0000};
+		}
+		device->stats.auditedSlots++;
+	}
+
+	/*Read and compare*/
+	status	=	n ? transfer(device, reads, n) : 0;
+	for (i = 0, address = 0; status == 0 && i < n; i++)
+	{
+		if (!reads[i].chained)
+			address	=	reads[i].data;
+		else if (reads[i].data != expected[i])
+		{
+			if (!mismatches)
+				printf("\x1B[31m[evg][checkSlots] %s: sequencer %u address %u register 0x%02x holds 0x%04x, 0x%04x was expected\n\x1B[0m", device->name, sequencer, address, reads[i].reg, reads[i].data, expected[i]);
+			mismatches++;
+		}
+	}
+	device->stats.slotMismatches	+=	mismatches;
+	if (mismatches > 1)
+		printf("\x1B[31m[evg][checkSlots] %s: %u words of sequencer %u differ from the image\n\x1B[0m", device->name, mismatches, sequencer);
+
+	free(reads);
+	free(expected);
+	if (status < 0)
+		return -1;
+	return mismatches ? 1 : 0;
+}
+
+/**
+ * @brief	Hashes a word of the sequencer image
+ *
+ * The hash of an image is the sum of the hashes of its valid words, so that it is updated
+ * in constant time when a word changes.
+ *
+ * @param	address	:	Address of the slot
+ * @param	field	:	Field of the word in the slot
+ * @param	data	:	Content of the word
+ * @return	Hash of the word
+ */
+static uint64_t
+wordHash(uint16_t address, uint16_t field, uint16_t data)
+{
+	uint64_t	value	=	((uint64_t)address << 32) | ((uint64_t)field << 16) | data;
+
+	/*splitmix64 finalizer*/
+	value	=	(value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value	=	(value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
+
+/**
+ * @brief	Checks whether the device echoes the reference field of requests
+ *
+ * Reads the firmware register with a tagged request using stop-and-wait.
+ * If the reply carries the same tag, replies can be matched to requests and the device
+ * is driven with a window of WINDOW_SIZE requests in flight.
+ * Otherwise the transport falls back to one request at a time, matched by address.
+ * A tagged device is then sent a datagram holding two requests; if both are answered,
+ * up to BATCH_RECORDS messages are packed in each datagram, otherwise one.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @return	0 on success, -1 on failure
+ */
+static long
+probe(void *dev)
+{
+	int32_t			status;
+	uint32_t		i;
+	uint32_t		retries;
+	uint32_t		reference;
+	uint32_t		answered;
+	message_t		message;
+	message_t		messages[MESSAGE_BUFFER];
+	device_t		*device	=	(device_t*)dev;
+	struct pollfd	events[1];
+
+	if (!dev)
+		return -1;
+
+	/*Stop-and-wait until proven otherwise*/
+	device->tagged	=	false;
+	device->window	=	1;
+	device->records	=	1;
+
+	for (retries = 0; retries < NUMBER_OF_RETRIES; retries++)
+	{
+		/*Drop late replies to previous attempts*/
+		drain(device);
+
+		/*Prepare message*/
+		reference			=	device->reference++;
+		message.access		=	ACCESS_READ;
+		message.status		=	0;
+		message.data		=	0x0000;
+		message.address		=	htonl(REGISTER_BASE_ADDRESS + REGISTER_FIRMWARE);
+		message.reference	=	htonl(reference);
+
+		/*Write to device*/
+		status	=	write(device->socket, &message, sizeof(message));
+		if (status != sizeof(message))
+			continue;
+
+		/*Prepare poll structure*/
+		events[0].fd		=	device->socket;
+		events[0].events	=	POLLIN;
+		events[0].revents	=	0;
+
+		/*Poll*/
+		status	=	poll(events, 1, TIMEOUT);
+		if (status <= 0)
+			continue;
+
+		/*Read from device*/
+		status	=	read(device->socket, &message, sizeof(message));
+		if (status == sizeof(message) && ntohl(message.address) == REGISTER_BASE_ADDRESS + REGISTER_FIRMWARE)
+			break;
+	}
+
+	if (retries >= NUMBER_OF_RETRIES)
+		return -1;
+
+	if (ntohl(message.reference) != reference)
+		return 0;
+	device->tagged	=	true;
+	device->window	=	WINDOW_SIZE;
+
+	/*Send two tagged requests in one datagram*/
+	reference	=	device->reference;
+	for (i = 0; i < 2; i++)
+	{
+		messages[i].access		=	ACCESS_READ;
+		messages[i].status		=	0;
+		messages[i].data		=	0x0000;
+		messages[i].address		=	htonl(REGISTER_BASE_ADDRESS + REGISTER_FIRMWARE);
+		messages[i].reference	=	htonl(device->reference++);
+	}
+	status	=	write(device->socket, messages, 2 * sizeof(message_t));
+	if (status != 2 * sizeof(message_t))
+		return 0;
+
+	/*Collect replies, which may come in one or several datagrams*/
+	for (answered = 0; answered != 3;)
+	{
+		events[0].fd		=	device->socket;
+		events[0].events	=	POLLIN;
+		events[0].revents	=	0;
+
+		status	=	poll(events, 1, TIMEOUT);
+		if (status <= 0)
+			break;
+
+		status	=	read(device->socket, messages, sizeof(messages));
+		for (i = 0; status > 0 && (i + 1) * sizeof(message_t) <= (uint32_t)status; i++)
+		{
+			if (ntohl(messages[i].reference) == reference)
+				answered	|=	1;
+			else if (ntohl(messages[i].reference) == reference + 1)
+				answered	|=	2;
+		}
+	}
+	if (answered == 3)
+		device->records	=	BATCH_RECORDS;
+
+	return 0;
+}
+
+/**
+ * @brief	Empties a batch
+ *
+ * @param	*batch	:	Batch to be initialized
+ */
+static void
+batchInit(batch_t *batch)
+{
+	batch->count	=	0;
+	batch->overflow	=	false;
+}
+
+/**
+ * @brief	Appends a register access to a batch
+ *
+ * @param	*batch		:	Batch being built
+ * @param	access		:	ACCESS_READ or ACCESS_WRITE
+ * @param	chained		:	Access depends on the target selected by the preceding access
+ * @param	reg			:	Address of register
+ * @param	data		:	16-bit data to be written
+ * @param	*result		:	Location where read data is stored, may be NULL
+ * @return	0 on success, -1 on failure
+ */
+static long
+batchAdd(batch_t *batch, uint8_t access, bool chained, evgregister_t reg, uint16_t data, uint16_t *result)
+{
+	if (batch->count >= BATCH_LENGTH)
+	{
+		batch->overflow	=	true;
+		return -1;
+	}
+
+	batch->accesses[batch->count].access	=	access;
+	batch->accesses[batch->count].chained	=	chained;
+	batch->accesses[batch->count].reg		=	reg;
+	batch->accesses[batch->count].data		=	data;
+	batch->results[batch->count]			=	result;
+	batch->count++;
+
+	return 0;
+}
+
+/**
+ * @brief	Carries out a batch and scatters read data back to the callers
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ * @param	*batch	:	Batch to be carried out
+ * @return	0 on success, -1 on failure
+ */
+static long
+batchRun(void *dev, batch_t *batch)
+{
+	int32_t		status;
+	uint32_t	i;
+
+	if (!dev || batch->overflow)
+		return -1;
+
+	status	=	transfer(dev, batch->accesses, batch->count);
+	if (status < 0)
+		return -1;
+
+	for (i = 0; i < batch->count; i++)
+		if (batch->results[i])
+			*batch->results[i]	=	batch->accesses[i].data;
+
+	return 0;
+}
+
+/**
+ * @brief	Locks the device mutex and accounts for the time spent waiting for it
+ *
+ * Also records when the holder asked for the device, so that reads carried out since then can be
+ * shared with it. Requests carried out by the worker asked for the device when they were queued.
+ *
+ * @param	*dev	:	A pointer to the device being acted upon
+ */
+static void
+lock(void *dev)
+{
+	uint64_t	start;
+	device_t	*device	=	(device_t*)dev;
+
+	start	=	now();
+	pthread_mutex_lock(&device->mutex);
+	histogramAdd(&device->stats.wait, now() - start);
+	if (device->queued && pthread_equal(pthread_self(), device->worker))
+		device->arrival	=	device->queued;
+	else
+		device->arrival	=	start;
+}
+
+/**
+ * @brief	Adds a sample to a histogram
+ *
+ * @param	*histogram	:	Histogram being updated
+ * @param	sample		:	Sample in microseconds
+ */
+static void
+histogramAdd(histogram_t *histogram, uint64_t sample)
+{
+	uint32_t	bin;
+
+	for (bin = 0; bin < HISTOGRAM_BINS - 1 && (sample >> (bin + 1)); bin++)
+		;
+	histogram->count++;
+	histogram->sum	+=	sample;
+	histogram->bins[bin]++;
+	if (sample > histogram->max)
+		histogram->max	=	sample;
+}
+
+/**
+ * @brief	Returns the current monotonic time in microseconds
+ */
+static uint64_t
+now(void)
+{
+	struct timespec	time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+/**
+ * @brief	Discards every datagram waiting in the socket of the device
+ *
+ * Late replies to requests that already timed out would otherwise be read as answers
+ * to the next requests. Discarded messages are accounted for as stale.
+ *
+ * @param	*device	:	Device whose socket is drained
+ */
+static void
+drain(device_t *device)
+{
+	int32_t		status;
+	message_t	messages[MESSAGE_BUFFER];
+
+	while ((status = recv(device->socket, messages, sizeof(messages), MSG_DONTWAIT)) > 0)
+		device->stats.stale	+=	(status + sizeof(message_t) - 1) / sizeof(message_t);
+}
+
+/**
+ * @brief	Feeds a round-trip time sample to the retransmission timeout estimator
+ *
+ * Follows Jacobson/Karels (RFC 6298): srtt and rttvar are smoothed with gains of 1/8 and 1/4,
+ * and the timeout is srtt + 4 * rttvar, bound by the floor and ceiling of the device.
+ *
+ * @param	*device	:	Device the sample was measured on
+ * @param	sample	:	Round-trip time in microseconds
+ */
+static void
+rttSample(device_t *device, uint64_t sample)
+{
+	int64_t		delta;
+	uint64_t	rto;
+
+	histogramAdd(&device->stats.rtt, sample);
+
+	if (!device->srtt)
+	{
+		device->srtt	=	sample ? sample : 1;
+		device->rttvar	=	sample / 2;
+	}
+	else
+	{
+		delta			=	(int64_t)sample - device->srtt;
+		device->srtt	+=	delta / 8;
+		device->rttvar	+=	((delta < 0 ? -delta : delta) - (int64_t)device->rttvar) / 4;
+		if (!device->srtt)
+			device->srtt	=	1;
+	}
+
+	rto	=	device->srtt + (4 * device->rttvar > RTO_GRANULARITY ? 4 * device->rttvar : RTO_GRANULARITY);
+	if (rto < device->rtoFloor)
+		rto	=	device->rtoFloor;
+	if (rto > device->rtoCeiling)
+		rto	=	device->rtoCeiling;
+	device->rto	=	rto;
+}
+
+/**
+ * @brief	Backs the retransmission timeout off after a request went unanswered
+ *
+ * Requests that were in flight together usually expire together, so the timeout is only
+ * doubled once for all requests sent before the previous backoff.
+ *
+ * @param	*device	:	Device the request was sent to
+ * @param	time	:	Time at which the request was sent
+ */
+static void
+rttTimeout(device_t *device, uint64_t time)
+{
+	if (time < device->backoff)
+		return;
+	device->rto		=	2 * device->rto < device->rtoCeiling ? 2 * device->rto : device->rtoCeiling;
+	device->backoff	=	now();
+}
+
+/**
+ * @brief	Returns the timeout of a transmission, doubled for every unanswered attempt
+ *
+ * @param	*device		:	Device the request is sent to
+ * @param	attempts	:	Number of unanswered attempts of the request
+ * @return	Timeout in microseconds
+ */
+static uint64_t
+rtoBackoff(device_t *device, uint32_t attempts)
+{
+	uint64_t	timeout	=	(uint64_t)device->rto << (attempts < 16 ? attempts : 16);
+
+	return timeout < device->rtoCeiling ? timeout : device->rtoCeiling;
+}
+
+/**
+ * @brief	Queues a group for (re)transmission
+ *
+ * @param	*t		:	Transfer in progress
+ * @param	g		:	Index of the group
+ * @param	full	:	Resend every access of the group, not only the head and the unacknowledged ones
+ */
+static void
+transferQueue(transfer_t *t, uint32_t g, bool full)
+{
+	uint32_t	i;
+	group_t		*group	=	&t->groups[g];
+
+	for (i = group->first; i < group->first + group->count; i++)
+	{
+		if (full || i == group->first || t->pending[i].state != STATE_ACKED)
+			t->pending[i].state	=	STATE_PENDING;
+		t->pending[i].sent	=	false;
+	}
+	if (group->stage != STAGE_QUEUED)
+		t->resent	=	true;
+	group->stage	=	STAGE_QUEUED;
+	group->corrupt	=	false;
+	t->queue[t->queueTail++ % t->groupCount]	=	g;
+}
+
+/**
+ * @brief	Marks a group as possibly overwritten by the chained writes of another group
+ *
+ * @param	*t	:	Transfer in progress
+ * @param	g	:	Index of the group, ignored if negative
+ */
+static void
+transferCorrupt(transfer_t *t, int32_t g)
+{
+	uint32_t	i;
+	group_t		*group;
+
+	if (g < 0)
+		return;
+	group	=	&t->groups[g];
+
+	switch (group->stage)
+	{
+		case STAGE_DONE:
+			t->doneCount--;
+			transferQueue(t, g, true);
+			break;
+		case STAGE_QUEUED:
+			for (i = group->first; i < group->first + group->count; i++)
+				t->pending[i].state	=	STATE_PENDING;
+			break;
+		default:
+			group->corrupt	=	true;
+			break;
+	}
+}
+
+/**
+ * @brief	Concludes the current attempt of a group once none of its accesses are in flight
+ *
+ * Completes the group if all accesses were acknowledged, otherwise queues it again.
+ * If the head was lost while chained writes landed, these writes hit whatever target the
+ * previous group selected, so that group is sent again as well.
+ *
+ * @param	*t	:	Transfer in progress
+ * @param	g	:	Index of the group
+ */
+static void
+transferResolve(transfer_t *t, uint32_t g)
+{
+	uint32_t	i;
+	bool		acked	=	true;
+	bool		head;
+	group_t		*group	=	&t->groups[g];
+
+	for (i = group->first; i < group->first + group->count; i++)
+	{
+		if (t->pending[i].state == STATE_ACKED)
+			continue;
+		acked	=	false;
+
+		/*Give up on accesses that went unanswered too many times*/
+		if (t->pending[i].sent && ++t->pending[i].attempts >= NUMBER_OF_RETRIES)
+		{
+			t->failed	=	true;
+			return;
+		}
+	}
+
+	if (acked && !group->corrupt)
+	{
+		group->stage	=	STAGE_DONE;
+		t->doneCount++;
+		return;
+	}
+
+	head	=	(t->pending[group->first].state == STATE_ACKED);
+	if (!head)
+	{
+		for (i = group->first + 1; i < group->first + group->count; i++)
+		{
+			if (t->accesses[i].access == ACCESS_WRITE && t->pending[i].sent && t->pending[i].state == STATE_ACKED)
+			{
+				transferCorrupt(t, group->previous);
+				break;
+			}
+		}
+	}
+
+	transferQueue(t, g, group->corrupt || !head);
+}
+
+/**
+ * @brief	Sends the messages waiting in the outgoing buffer as one datagram
+ *
+ * A failed write is not reported, the accesses simply expire and are retransmitted.
+ * Replies of an untagged device are matched by address only, so the socket is drained first
+ * to keep a late reply to an expired request from answering the new one.
+ *
+ * @param	*t	:	Transfer in progress
+ */
+static void
+transferPost(transfer_t *t)
+{
+	int32_t		status;
+
+	if (!t->outgoingCount)
+		return;
+
+	/*Drop late replies*/
+	if (!t->device->tagged)
+		drain(t->device);
+
+	/*Write to device*/
+	status	=	write(t->device->socket, t->outgoing, t->outgoingCount * sizeof(message_t));
+	(void)status;
+	t->device->stats.datagrams++;
+
+	t->outgoingCount	=	0;
+}
+
+/**
+ * @brief	Queues an access in the outgoing datagram and tracks it as in flight
+ *
+ * @param	*t	:	Transfer in progress
+ * @param	i	:	Index of the access
+ */
+static void
+transferSend(transfer_t *t, uint32_t i)
+{
+	message_t	*message;
+	access_t	*access		=	&t->accesses[i];
+	pending_t	*pending	=	&t->pending[i];
+	device_t	*device		=	t->device;
+
+	/*Make room in the outgoing datagram*/
+	if (t->outgoingCount >= device->records)
+		transferPost(t);
+	message	=	&t->outgoing[t->outgoingCount++];
+
+	/*Tag request, zero is never used*/
+	device->stats.messages++;
+	if (pending->reference)
+		device->stats.retries++;
+	if (!device->reference)
+		device->reference++;
+	pending->reference	=	device->reference++;
+
+	/*Prepare message*/
+	message->access		=	access->access;
+	message->status		=	0;
+	message->data		=	(access->access == ACCESS_WRITE) ? htons(access->data) : 0x0000;
+	message->address	=	htonl(REGISTER_BASE_ADDRESS + access->reg);
+	message->reference	=	htonl(pending->reference);
+
+	pending->state		=	STATE_INFLIGHT;
+	pending->sent		=	true;
+	pending->time		=	now();
+	pending->deadline	=	pending->time + rtoBackoff(device, pending->attempts);
+	t->inflight[t->inflightCount++]	=	i;
+	t->groups[pending->group].outstanding++;
+}
+
+/**
+ * @brief	Removes an access from the in-flight list and concludes its group if possible
+ *
+ * @param	*t		:	Transfer in progress
+ * @param	slot	:	Position of the access in the in-flight list
+ * @param	state	:	New state of the access
+ */
+static void
+transferRetire(transfer_t *t, uint32_t slot, state_t state)
+{
+	uint32_t	i	=	t->inflight[slot];
+	uint32_t	g	=	t->pending[i].group;
+
+	t->inflight[slot]	=	t->inflight[--t->inflightCount];
+	t->pending[i].state	=	state;
+
+	if (!--t->groups[g].outstanding && t->current != (int32_t)g)
+		transferResolve(t, g);
+}
+
+/**
+ * @brief	Matches a reply to an access in flight
+ *
+ * Replies are matched by tag, address, and access type when the device echoes tags,
+ * otherwise by address and access type.
+ * Replies that match nothing are stale (e.g. answers to retransmitted requests) and are dropped.
+ * The round-trip time of the access feeds the retransmission timeout estimator. Since each
+ * transmission carries its own tag, replies to retransmissions are timed correctly as well.
+ *
+ * @param	*t			:	Transfer in progress
+ * @param	*message	:	Reply received from the device
+ */
+static void
+transferMatch(transfer_t *t, const message_t *message)
+{
+	uint32_t	slot;
+	uint32_t	i;
+
+	for (slot = 0; slot < t->inflightCount; slot++)
+	{
+		i	=	t->inflight[slot];
+		if (ntohl(message->address) != REGISTER_BASE_ADDRESS + t->accesses[i].reg)
+			continue;
+		if (message->access != t->accesses[i].access)
+			continue;
+		if (t->device->tagged && ntohl(message->reference) != t->pending[i].reference)
+			continue;
+
+		if (t->accesses[i].access == ACCESS_READ)
+			t->accesses[i].data	=	ntohs(message->data);
+		t->device->stats.replies++;
+		rttSample(t->device, now() - t->pending[i].time);
+		transferRetire(t, slot, STATE_ACKED);
+		return;
+	}
+	t->device->stats.stale++;
+}
+
+/**
+ * @brief	Sends queued accesses while the window allows it
+ *
+ * Groups are sent one after the other so that chained accesses directly follow their head.
+ * Messages are packed into datagrams of up to device->records messages, and a group is not
+ * split across datagrams unless it is larger than one, so that it is delivered or lost as a whole.
+ * For the same reason, a group is only started once the window has room for all of it.
+ * A group is fenced when a lost head cannot be repaired by resending the previous group;
+ * its chained accesses are then held back until the head is acknowledged.
+ *
+ * @param	*t	:	Transfer in progress
+ */
+static void
+transferFlush(transfer_t *t)
+{
+	uint32_t	g;
+	uint32_t	head;
+	group_t		*group;
+
+	while (!t->failed && t->inflightCount < t->device->window)
+	{
+		/*Pick next group*/
+		if (t->current < 0)
+		{
+			if (t->queueHead == t->queueTail)
+				break;
+			g				=	t->queue[t->queueHead % t->groupCount];
+			group			=	&t->groups[g];
+			if (t->inflightCount && t->inflightCount + group->count > t->device->window)
+				break;
+			t->queueHead++;
+			if (t->outgoingCount + group->count > t->device->records)
+				transferPost(t);
+			group->stage	=	STAGE_ACTIVE;
+			if (group->count > 1)
+			{
+				head			=	(t->accesses[group->first].reg >> 1) % REGISTER_COUNT;
+				group->previous	=	t->last[head];
+				group->fenced	=	group->writes && (group->previous < 0 || (group->writes & ~t->groups[group->previous].writes));
+				t->last[head]	=	g;
+			}
+			t->current	=	g;
+			t->cursor	=	group->first;
+		}
+		g		=	t->current;
+		group	=	&t->groups[g];
+
+		/*Skip accesses that need not be sent*/
+		while (t->cursor < group->first + group->count && t->pending[t->cursor].state != STATE_PENDING)
+			t->cursor++;
+		if (t->cursor >= group->first + group->count)
+		{
+			t->current	=	-1;
+			if (!group->outstanding)
+				transferResolve(t, g);
+			continue;
+		}
+
+		/*Hold chained accesses back until the head is acknowledged*/
+		if (group->fenced && t->cursor != group->first && t->pending[group->first].state != STATE_ACKED)
+		{
+			if (t->pending[group->first].state == STATE_INFLIGHT)
+			{
+				transferPost(t);
+				break;
+			}
+			t->current	=	-1;
+			if (!group->outstanding)
+				transferResolve(t, g);
+			continue;
+		}
+
+		transferSend(t, t->cursor++);
+	}
+
+	transferPost(t);
+}
+
+/**
+ * @brief	Maps a sequencer RAM register to the field of a slot
+ *
+ * @param	reg			:	Address of register
+ * @param	*sequencer	:	Sequencer the register belongs to
+ * @return	Index of the field within the slot, -1 if the register is not part of the sequencer RAM
+ */
+static int32_t
+slotField(uint16_t reg, uint8_t *sequencer)
+{
+	*sequencer	=	reg >= REGISTER_SEQ_ADDRESS1;
+	switch (reg)
+	{
+		case REGISTER_SEQ_CODE0:
+		case REGISTER_SEQ_CODE1:
+			return 0;
+		case REGISTER_SEQ_TIME0:
+		case REGISTER_SEQ_TIME1:
+			return 1;
+		case REGISTER_SEQ_TIME0+2:
+		case REGISTER_SEQ_TIME1+2:
+			return 2;
+		default:
+			return -1;
+	}
+}
+
+/**
+ * @brief	Updates the shadow copy with the outcome of a transfer
+ *
+ * Acknowledged accesses to shadowed registers store their data in the shadow copy,
+ * writes that were not acknowledged leave the register in an unknown state and invalidate it,
+ * and so do reads that were not acknowledged, whose value could not be confirmed.
+ * So do selector writes of a transfer that sent a group again, which may have landed out of order.
+ * Accesses to the sequencer RAM update the image of the slot selected by the shadowed address
+ * register. A write that may have landed on an unknown slot invalidates the whole image.
+ * Other chained accesses target memory selected by their head and are never shadowed.
+ * Acknowledged writes are also recorded as the settings of the IOC, which a reset of the
+ * device loses and resync() replays. Reads never change the settings.
+ *
+ * @param	*t	:	Transfer that just ended
+ */
+static void
+transferShadow(transfer_t *t)
+{
+	uint32_t	i;
+	uint16_t	data;
+	uint16_t	address;
+	uint16_t	control;
+	uint16_t	word;
+	int32_t		field;
+	uint8_t		sequencer;
+	access_t	*access;
+	device_t	*device	=	t->device;
+	evgregister_t	selector;
+
+	shadowBegin(device);
+	for (i = 0; i < t->count; i++)
+	{
+		access	=	&t->accesses[i];
+
+		/*Sequencer RAM*/
+		field	=	slotField(access->reg, &sequencer);
+		if (field >= 0)
+		{
+			selector	=	sequencerRegisters[sequencer].slot[0];
+			address		=	device->shadow[selector >> 1] % NUMBER_OF_ADDRESSES;
+			if (t->pending[i].state == STATE_ACKED && (device->shadowValid & REGISTER_BIT(selector)))
+			{
+				if (device->imageValid[sequencer][address] & (1 << field))
+					device->imageHash[sequencer]	-=	wordHash(address, field, device->image[sequencer][address][field]);
+				device->imageHash[sequencer]				+=	wordHash(address, field, access->data);
+				device->image[sequencer][address][field]	=	access->data;
+				device->imageValid[sequencer][address]		|=	1 << field;
+			}
+			else if (access->access == ACCESS_WRITE)
+			{
+				memset(device->imageValid[sequencer], 0, sizeof(device->imageValid[sequencer]));
+				device->imageHash[sequencer]	=	0;
+			}
+			continue;
+		}
+
+		/*Counter prescaler words, selected by the shadowed counter register*/
+		if (access->reg == REGISTER_MXC_PRESCALER && access->access == ACCESS_WRITE && (device->shadowValid & REGISTER_BIT(REGISTER_MXC_CONTROL)))
+		{
+			control	=	device->shadow[REGISTER_MXC_CONTROL >> 1];
+			word	=	(control % NUMBER_OF_COUNTERS) * 2 + !!(control & MXC_CONTROL_HIGH_WORD);
+			if (t->pending[i].state == STATE_ACKED)
+			{
+				device->counterSettings[word]	=	access->data;
+				device->counterValid			|=	1 << word;
+			}
+			else
+				device->counterValid			&=	~(1 << word);
+		}
+
+		/*Recent reads, shared with later requesters*/
+		if (access->access == ACCESS_WRITE)
+			device->recentTime[(access->reg >> 1) % REGISTER_COUNT]	=	0;
+		else if (!access->chained && !(INDEXED_REGISTERS & REGISTER_BIT(access->reg)) && t->pending[i].state == STATE_ACKED)
+		{
+			device->recent[(access->reg >> 1) % REGISTER_COUNT]		=	access->data;
+			device->recentTime[(access->reg >> 1) % REGISTER_COUNT]	=	t->pending[i].time;
+		}
+
+		if (access->chained || !(SHADOW_REGISTERS & REGISTER_BIT(access->reg)))
+			continue;
+		if (t->pending[i].state == STATE_ACKED)
+		{
+			data	=	access->data;
+			if (access->reg == REGISTER_CONTROL)
+				data	&=	~SHADOW_CONTROL_VOLATILE;
+			device->shadow[(access->reg >> 1) % REGISTER_COUNT]	=	data;
+			device->shadowValid	|=	REGISTER_BIT(access->reg);
+			if (access->access == ACCESS_WRITE)
+			{
+				device->settings[(access->reg >> 1) % REGISTER_COUNT]	=	data;
+				device->settingsValid	|=	REGISTER_BIT(access->reg);
+			}
+		}
+		if (t->resent && access->access == ACCESS_WRITE && (SELECTOR_REGISTERS & REGISTER_BIT(access->reg)))
+			device->shadowValid	&=	~REGISTER_BIT(access->reg);
+		if (t->pending[i].state != STATE_ACKED)
+		{
+			device->shadowValid		&=	~REGISTER_BIT(access->reg);
+			if (access->access == ACCESS_WRITE)
+				device->settingsValid	&=	~REGISTER_BIT(access->reg);
+		}
+	}
+	shadowEnd(device);
+}
+
 /**
- * @brief	Reads 16-bit register from device
+ * @brief	Carries out a list of register accesses
  *
- * Prepares UDP message, sends it to device, and reads back reply.
- * Times out and retransmits upon detecting any communication failures.
+ * Accesses gathered before the call are carried out first, see gatherFlush.
+ * Keeps up to device->window requests in flight, each tagged with a sequence number in the
+ * reference field. Replies are matched out of order and only the missing requests are
+ * retransmitted, up to NUMBER_OF_RETRIES times. Chained accesses are delivered right after
+ * their head, and retransmitted together with it.
  *
- * @param	*dev	:	A pointer to the device being acted upon
- * @param	reg		:	Address of register to be read
- * @param	*data	:	16-bit data read from register
+ * @param	*dev		:	A pointer to the device being acted upon
+ * @param	*accesses	:	Accesses to be carried out, read data is stored in place
+ * @param	count		:	Number of accesses
  * @return	0 on success, -1 on failure
  */
 static long
-readreg(void *dev, evgregister_t reg, uint16_t *data)
+transfer(void *dev, access_t *accesses, uint32_t count)
 {
 	int32_t			status;
-	uint32_t		retries;
-	message_t		message;
+	uint32_t		i;
+	uint32_t		slot;
+	uint64_t		time;
+	uint64_t		deadline;
+	bool			control	=	false;
+	pending_t		localPending[GROUP_LENGTH];
+	group_t			localGroups[GROUP_LENGTH];
+	uint32_t		localQueue[GROUP_LENGTH];
+	message_t		messages[MESSAGE_BUFFER];
+	transfer_t		t;
+	group_t			*group	=	NULL;
 	device_t		*device	=	(device_t*)dev;
 	struct pollfd	events[1];
 
 	/*Check inputs*/
-	if (!dev || !data)
+	if (!dev || !accesses)
+		return -1;
+	if (!count)
+		return 0;
+
+	/*Fail fast while the device is offline, unless it is being started*/
+	if (!device->online && !pthread_equal(pthread_self(), device->starter))
+	{
+		device->stats.failures++;
+		return -1;
+	}
+
+	/*Keep accesses in order: gathered accesses go out first*/
+	if (device->gatherCount && accesses != device->gather)
+		gatherFlush(device);
+
+	/*Prepare transfer*/
+	memset(&t, 0, sizeof(t));
+	t.device	=	device;
+	t.accesses	=	accesses;
+	t.count		=	count;
+	t.current	=	-1;
+	for (i = 0; i < REGISTER_COUNT; i++)
+		t.last[i]	=	-1;
+	if (count <= GROUP_LENGTH)
+	{
+		t.pending	=	localPending;
+		t.groups	=	localGroups;
+		t.queue		=	localQueue;
+	}
+	else
+	{
+		t.pending	=	malloc(count * sizeof(pending_t));
+		t.groups	=	malloc(count * sizeof(group_t));
+		t.queue		=	malloc(count * sizeof(uint32_t));
+		if (!t.pending || !t.groups || !t.queue)
+		{
+			free(t.pending);
+			free(t.groups);
+			free(t.queue);
+			return -1;
+		}
+	}
+
+	/*Split accesses into groups*/
+	for (i = 0; i < count; i++)
+	{
+		if (!i || !accesses[i].chained)
+		{
+			group				=	&t.groups[t.groupCount++];
+			memset(group, 0, sizeof(*group));
+			group->first		=	i;
+			group->previous		=	-1;
+		}
+		if (++group->count > GROUP_LENGTH)
+			t.failed	=	true;
+		t.pending[i].attempts	=	0;
+		t.pending[i].reference	=	0;
+		if (i != group->first && accesses[i].access == ACCESS_WRITE)
+			group->writes	|=	1ULL << ((accesses[i].reg >> 1) % REGISTER_COUNT);
+		t.pending[i].group	=	t.groupCount - 1;
+		if (accesses[i].access == ACCESS_WRITE && accesses[i].reg == REGISTER_CONTROL)
+			control	=	true;
+	}
+	for (i = 0; i < t.groupCount; i++)
+		transferQueue(&t, i, true);
+
+	/*Keep the priority lane off the control register while it is written*/
+	if (control)
+		laneHold(device);
+
+	/*Drop replies left over by previous transfers*/
+	drain(device);
+
+	/*Run transfer*/
+	while (!t.failed && t.doneCount < t.groupCount)
+	{
+		/*Send as much as the window allows*/
+		transferFlush(&t);
+		if (t.failed || t.doneCount >= t.groupCount)
+			break;
+		if (!t.inflightCount)
+		{
+			t.failed	=	true;
+			break;
+		}
+
+		/*Wait for the first reply or the earliest deadline*/
+		deadline	=	t.pending[t.inflight[0]].deadline;
+		for (slot = 1; slot < t.inflightCount; slot++)
+			if (t.pending[t.inflight[slot]].deadline < deadline)
+				deadline	=	t.pending[t.inflight[slot]].deadline;
+		time	=	now();
+
+		/*Prepare poll structure*/
+		events[0].fd		=	device->socket;
+		events[0].events	=	POLLIN;
+		events[0].revents	=	0;
+
+		/*Poll*/
+		status	=	poll(events, 1, deadline > time ? (deadline - time + 999) / 1000 : 0);
+		if (status > 0)
+		{
+			/*Read every datagram available*/
+			while ((status = recv(device->socket, messages, sizeof(messages), MSG_DONTWAIT)) > 0)
+			{
+				if (status % sizeof(message_t))
+					device->stats.shortReads++;
+				for (i = 0; (i + 1) * sizeof(message_t) <= (uint32_t)status; i++)
+					transferMatch(&t, &messages[i]);
+			}
+		}
+
+		/*Expire requests that were not answered in time*/
+		time	=	now();
+		for (slot = 0; slot < t.inflightCount;)
+		{
+			if (t.pending[t.inflight[slot]].deadline <= time)
+			{
+				device->stats.timeouts++;
+				rttTimeout(device, t.pending[t.inflight[slot]].time);
+				transferRetire(&t, slot, STATE_EXPIRED);
+			}
+			else
+				slot++;
+		}
+	}
+
+	/*Keep the shadow copy in step with the device*/
+	transferShadow(&t);
+	if (control)
+		laneRelease(device);
+
+	device->stats.transfers++;
+	device->stats.accesses	+=	count;
+	if (t.failed)
+		device->stats.failures++;
+
+	if (count > GROUP_LENGTH)
+	{
+		free(t.pending);
+		free(t.groups);
+		free(t.queue);
+	}
+
+	return t.failed ? -1 : 0;
+}
+
+/**
+ * @brief	Writes a register through the priority lane
+ *
+ * The priority lane has a socket of its own and never takes the device mutex, so that the write
+ * goes out right away, even while a transfer holds the device (e.g. a sequence upload).
+ * The write is sent once and the call returns without waiting: the acknowledgement is matched
+ * by the acknowledger thread, and a write that is not acknowledged within the retransmission
+ * timeout ceiling is reported as unconfirmed rather than sent again, since triggers and software
+ * events are not idempotent.
+ *
+ * @param	*device	:	Device being written
+ * @param	reg		:	Register address
+ * @param	data	:	Data to be written
+ * @return	0 on success, -1 on failure
+ */
+static long
+urgent(device_t *device, evgregister_t reg, uint16_t data)
+{
+	int32_t		status;
+
+	pthread_mutex_lock(&device->laneMutex);
+	status	=	laneSend(device, reg, data);
+	pthread_mutex_unlock(&device->laneMutex);
+
+	return status;
+}
+
+/**
+ * @brief	Writes a register through the priority lane, with the lane mutex held
+ *
+ * See urgent().
+ *
+ * @param	*device	:	Device being written
+ * @param	reg		:	Register address
+ * @param	data	:	Data to be written
+ * @return	0 on success, -1 on failure
+ */
+static long
+laneSend(device_t *device, evgregister_t reg, uint16_t data)
+{
+	int32_t		status;
+	message_t	message;
+	urgent_t	*entry;
+
+	/*Fail fast while the device is offline*/
+	if (!device->online)
 		return -1;
 
+	/*Make room by giving up on the oldest write*/
+	if (device->laneCount >= LANE_LENGTH)
+	{
+		device->laneStats.unconfirmed++;
+		memmove(&device->lane[0], &device->lane[1], --device->laneCount * sizeof(urgent_t));
+		pthread_cond_broadcast(&device->laneCondition);
+	}
+
+	/*Tag request, zero is never used*/
+	if (!++device->laneReference)
+		device->laneReference++;
+
 	/*Prepare message*/
-	message.access		=	ACCESS_READ;
+	message.access		=	ACCESS_WRITE;
 	message.status		=	0;
-	message.data		=	0x0000;
+	message.data		=	htons(data);
 	message.address		=	htonl(REGISTER_BASE_ADDRESS + reg);
-	message.reference	=	0x00000000;
+	message.reference	=	htonl(device->laneReference);
+
+	/*Write to device*/
+	status	=	write(device->laneSocket, &message, sizeof(message));
+	if (status != sizeof(message))
+	{
+		printf("\x1B[31m[evg][urgent] %s: Unable to send priority write\n\x1B[0m", device->name);
+		return -1;
+	}
+
+	/*Wait for the acknowledgement in the background*/
+	entry				=	&device->lane[device->laneCount++];
+	entry->reg			=	reg;
+	entry->data			=	data;
+	entry->reference	=	device->laneReference;
+	entry->time			=	now();
+	device->laneStats.writes++;
+
+	return 0;
+}
+
+/**
+ * @brief	Keeps the priority lane off the control register during a transfer
+ *
+ * Called before a transfer that writes the control register. From then on triggers go through
+ * the device mutex, and the transfer waits for the control writes still in the lane to be
+ * acknowledged or given up, so that the device sees them before the transfer's own writes.
+ *
+ * @param	*device	:	Device being written
+ */
+static void
+laneHold(device_t *device)
+{
+	uint32_t	i;
+
+	pthread_mutex_lock(&device->laneMutex);
+	device->controlWrites++;
+	for (i = 0; i < device->laneCount;)
+	{
+		if (device->lane[i].reg != REGISTER_CONTROL)
+			i++;
+		else
+		{
+			pthread_cond_wait(&device->laneCondition, &device->laneMutex);
+			i	=	0;
+		}
+	}
+	pthread_mutex_unlock(&device->laneMutex);
+}
+
+/**
+ * @brief	Lets the priority lane write the control register again, once the shadow copy is updated
+ *
+ * @param	*device	:	Device being written
+ */
+static void
+laneRelease(device_t *device)
+{
+	pthread_mutex_lock(&device->laneMutex);
+	device->controlWrites--;
+	pthread_mutex_unlock(&device->laneMutex);
+}
+
+/**
+ * @brief	Matches the acknowledgements of priority writes
+ *
+ * Replies are matched like those of a transfer, see transferMatch().
+ * Writes that are not acknowledged within the retransmission timeout ceiling are unconfirmed.
+ *
+ * @param	*arg	:	A pointer to the device
+ * @return	NULL
+ */
+static void*
+acknowledger(void *arg)
+{
+	int32_t			status;
+	int32_t			timeout;
+	uint32_t		i;
+	uint32_t		j;
+	uint64_t		time;
+	message_t		messages[MESSAGE_BUFFER];
+	device_t		*device	=	(device_t*)arg;
+	struct pollfd	events[1];
+
+	for (;;)
+	{
+		/*Wait for a reply or the expiry of the oldest write*/
+		pthread_mutex_lock(&device->laneMutex);
+		time	=	now();
+		timeout	=	TIMEOUT;
+		if (device->laneCount)
+			timeout	=	device->lane[0].time + device->rtoCeiling > time ? (device->lane[0].time + device->rtoCeiling - time + 999) / 1000 : 0;
+		pthread_mutex_unlock(&device->laneMutex);
+
+		events[0].fd		=	device->laneSocket;
+		events[0].events	=	POLLIN;
+		events[0].revents	=	0;
+		status	=	poll(events, 1, timeout);
+
+		pthread_mutex_lock(&device->laneMutex);
+
+		/*Match replies*/
+		while (status > 0 && (status = recv(device->laneSocket, messages, sizeof(messages), MSG_DONTWAIT)) > 0)
+		{
+			for (i = 0; (i + 1) * sizeof(message_t) <= (uint32_t)status; i++)
+			{
+				for (j = 0; j < device->laneCount; j++)
+				{
+					if (ntohl(messages[i].address) != REGISTER_BASE_ADDRESS + device->lane[j].reg || messages[i].access != ACCESS_WRITE)
+						continue;
+					if (device->tagged && ntohl(messages[i].reference) != device->lane[j].reference)
+						continue;
+					device->laneStats.acks++;
+					histogramAdd(&device->laneStats.rtt, now() - device->lane[j].time);
+					memmove(&device->lane[j], &device->lane[j + 1], (--device->laneCount - j) * sizeof(urgent_t));
+					pthread_cond_broadcast(&device->laneCondition);
+					break;
+				}
+			}
+		}
+
+		/*Give up on writes that were not acknowledged in time*/
+		time	=	now();
+		while (device->laneCount && device->lane[0].time + device->rtoCeiling <= time)
+		{
+			printf("\x1B[31m[evg][acknowledger] %s: Priority write of 0x%04x to register 0x%02x was not acknowledged\n\x1B[0m", device->name, device->lane[0].data, device->lane[0].reg);
+			device->laneStats.unconfirmed++;
+			memmove(&device->lane[0], &device->lane[1], --device->laneCount * sizeof(urgent_t));
+			pthread_cond_broadcast(&device->laneCondition);
+		}
+
+		pthread_mutex_unlock(&device->laneMutex);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Hashes a device name into a bucket of the device table
+ *
+ * @param	*name	:	Device name
+ * @return	Bucket of the name
+ */
+static uint32_t
+hash(const char *name)
+{
+	uint32_t	value	=	2166136261u;
+
+	/*FNV-1a*/
+	while (*name)
+		value	=	(value ^ (uint8_t)*name++) * 16777619u;
+
+	return value & (DEVICE_BUCKETS - 1);
+}
+
+/**
+ * @brief	Carries out the requests queued to a device
+ *
+ * One worker runs per device, so record IO no longer needs a thread per request. The worker
+ * still takes the device mutex for each request, to count it and through the evg_* call that
+ * carries it out, so callers outside the worker still wait for it as before.
+ * With a gather window, the worker waits for the window of the oldest request to pass, then carries
+ * out every request queued by then as a group: their writes are gathered and go out in one transfer,
+ * after which the requests complete together. Without one, requests are carried out one by one.
+ * Deferred writes are verified whenever the queue drains.
+ * When no request arrives for SHADOW_PERIOD seconds, the worker resyncs the shadow registers,
+ * which the lockless getters keep being served from meanwhile, see refresh().
+ *
+ * @param	*arg	:	A pointer to the device
+ * @return	NULL
+ */
+static void*
+worker(void *arg)
+{
+	int32_t			status;
+	uint32_t		i;
+	uint32_t		k;
+	uint32_t		count;
+	bool			idle;
+	bool			gathering;
+	uint64_t		time;
+	uint64_t		queued[GATHER_REQUESTS];
+	evgrequest_t	*requests[GATHER_REQUESTS];
+	evgrequest_t	*request;
+	struct timespec	deadline;
+	device_t		*device	=	(device_t*)arg;
+
+	for (;;)
+	{
+		/*Wait for a request*/
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec	+=	SHADOW_PERIOD;
+		pthread_mutex_lock(&device->requestMutex);
+		for (status = 0; !status && device->requestHead == device->requestTail;)
+			status	=	pthread_cond_timedwait(&device->requestCondition, &device->requestMutex, &deadline);
+		if (device->requestHead == device->requestTail)
+		{
+			/*Idle, resync the shadow registers without invalidating them first*/
+			pthread_mutex_unlock(&device->requestMutex);
+			if (device->online)
+			{
+				evg_verify(device);
+				evg_refresh(device);
+			}
+			continue;
+		}
+
+		/*Gather the requests queued within the window of the oldest one*/
+		gathering	=	device->gatherWindow > 0;
+		while (gathering && device->requestTail - device->requestHead < GATHER_REQUESTS)
+		{
+			time	=	now();
+			if (time >= device->requestTimes[device->requestHead % QUEUE_LENGTH] + device->gatherWindow)
+				break;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec	+=	(device->requestTimes[device->requestHead % QUEUE_LENGTH] + device->gatherWindow - time) * 1000;
+			deadline.tv_sec		+=	deadline.tv_nsec / 1000000000L;
+			deadline.tv_nsec	%=	1000000000L;
+			pthread_cond_timedwait(&device->requestCondition, &device->requestMutex, &deadline);
+		}
+		count	=	gathering ? device->requestTail - device->requestHead : 1;
+		if (count > GATHER_REQUESTS)
+			count	=	GATHER_REQUESTS;
+		for (k = 0; k < count; k++)
+		{
+			queued[k]	=	device->requestTimes[device->requestHead % QUEUE_LENGTH];
+			requests[k]	=	device->requests[device->requestHead++ % QUEUE_LENGTH];
+		}
+		idle	=	device->requestHead == device->requestTail;
+		pthread_mutex_unlock(&device->requestMutex);
+
+		for (k = 0; k < count; k++)
+		{
+			request	=	requests[k];
+
+			/*Count requests per command*/
+			lock(device);
+			for (i = 0; i < device->stats.commandCount; i++)
+				if (strcmp(device->stats.commands[i], request->name ? request->name : "") == 0)
+					break;
+			if (i >= device->stats.commandCount && i < STATS_COMMANDS)
+				device->stats.commands[device->stats.commandCount++]	=	request->name ? request->name : "";
+			if (i < STATS_COMMANDS)
+				device->stats.requests[i]++;
+			if (!k && gathering)
+				device->stats.groups++;
+			device->gatherFailed[k]	=	false;
+			device->gatherCurrent	=	k;
+			device->gathering		=	gathering;
+			pthread_mutex_unlock(&device->mutex);
+
+			/*Carry it out*/
+			device->queued	=	queued[k];
+			request->function(request->arg);
+			device->queued	=	0;
+			if (!gathering && request->complete)
+				request->complete(request->arg, 0);
+		}
+
+		/*Send the gathered writes and complete the group*/
+		if (gathering)
+		{
+			lock(device);
+			gatherFlush(device);
+			device->gathering	=	false;
+			pthread_mutex_unlock(&device->mutex);
+			for (k = 0; k < count; k++)
+				if (requests[k]->complete)
+					requests[k]->complete(requests[k]->arg, device->gatherFailed[k] ? -1 : 0);
+		}
+
+		/*Verify deferred writes once the queue drains*/
+		if (idle && device->verify == VERIFY_DEFERRED)
+			evg_verify(device);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Prints the statistics of a device
+ *
+ * Counters and mean latencies are printed at detail level 1,
+ * latency histograms and requests per command at level 2 and above.
+ *
+ * @param	*dev	:	A pointer to the device being reported
+ * @param	detail	:	Level of detail requested
+ */
+static void
+statsPrint(void *dev, int detail)
+{
+	uint32_t	i;
+	uint32_t	bin;
+	uint32_t	rto;
+	uint32_t	srtt;
+	uint32_t	rttvar;
+	stats_t		stats;
+	lanestats_t	lane;
+	device_t	*device	=	(device_t*)dev;
+	histogram_t	*histograms[2];
+	const char	*names[2]	=	{"RTT", "Mutex wait"};
+
+	/*Take a consistent copy*/
+	lock(device);
+	stats	=	device->stats;
+	rto		=	device->rto;
+	srtt	=	device->srtt;
+	rttvar	=	device->rttvar;
+	pthread_mutex_lock(&device->laneMutex);
+	lane	=	device->laneStats;
+	pthread_mutex_unlock(&device->laneMutex);
+	pthread_mutex_unlock(&device->mutex);
+
+	printf("Transfers: %llu (%llu failed), accesses: %llu\n", (unsigned long long)stats.transfers, (unsigned long long)stats.failures, (unsigned long long)stats.accesses);
+	printf("Messages: %llu in %llu datagrams, retries: %llu, timeouts: %llu\n", (unsigned long long)stats.messages, (unsigned long long)stats.datagrams, (unsigned long long)stats.retries, (unsigned long long)stats.timeouts);
+	printf("Replies: %llu, stale: %llu, short reads: %llu, coalesced reads: %llu, lockless reads: %llu\n", (unsigned long long)stats.replies, (unsigned long long)stats.stale, (unsigned long long)stats.shortReads, (unsigned long long)stats.coalesced, (unsigned long long)stats.lockless);
+	printf("Groups: %llu, gathered writes: %llu, resets: %llu\n", (unsigned long long)stats.groups, (unsigned long long)stats.gathered, (unsigned long long)stats.resets);
+	printf("RTT: mean %.1f us, max %llu us\n", stats.rtt.count ? (double)stats.rtt.sum / stats.rtt.count : 0.0, (unsigned long long)stats.rtt.max);
+	printf("RTO: %u us, srtt %u us, rttvar %u us\n", rto, srtt, rttvar);
+	printf("Mutex wait: mean %.1f us, max %llu us\n", stats.wait.count ? (double)stats.wait.sum / stats.wait.count : 0.0, (unsigned long long)stats.wait.max);
+	printf("Priority writes: %llu, acknowledged: %llu, unconfirmed: %llu, RTT: mean %.1f us, max %llu us\n", (unsigned long long)lane.writes, (unsigned long long)lane.acks, (unsigned long long)lane.unconfirmed, lane.rtt.count ? (double)lane.rtt.sum / lane.rtt.count : 0.0, (unsigned long long)lane.rtt.max);
+	if (detail < 2)
+		return;
+
+	histograms[0]	=	&stats.rtt;
+	histograms[1]	=	&stats.wait;
+	for (i = 0; i < 2; i++)
+	{
+		printf("%s histogram:\n", names[i]);
+		for (bin = 0; bin < HISTOGRAM_BINS; bin++)
+			if (histograms[i]->bins[bin])
+				printf("\t%8llu - %8llu us: %llu\n", bin ? 1ULL << bin : 0ULL, (2ULL << bin) - 1, (unsigned long long)histograms[i]->bins[bin]);
+	}
+	printf("Requests per command:\n");
+	for (i = 0; i < stats.commandCount; i++)
+		printf("\t%-24s %llu\n", stats.commands[i], (unsigned long long)stats.requests[i]);
+}
+
+/**
+ * @brief	Audits the sequencer RAM in the background
+ *
+ * @param	*arg	:	A pointer to the device
+ * @return	NULL
+ */
+static void*
+auditor(void *arg)
+{
+	uint8_t		sequencer;
+	uint16_t	first;
+	device_t	*device	=	(device_t*)arg;
+
+	for (;;)
+	{
+		usleep((device->auditPeriod ? device->auditPeriod : 1000) * 1000);
+		if (!device->auditPeriod || !device->online)
+			continue;
+
+		lock(device);
+		sequencer	=	device->auditCursor / NUMBER_OF_ADDRESSES;
+		first		=	device->auditCursor % NUMBER_OF_ADDRESSES;
+		checkSlots(device, sequencer, first, AUDIT_SLOTS, false);
+		device->auditCursor	=	(device->auditCursor + AUDIT_SLOTS) % (NUMBER_OF_SEQUENCERS * NUMBER_OF_ADDRESSES);
+		pthread_mutex_unlock(&device->mutex);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Polls the registers read by I/O Intr records
+ *
+ * Once per period, reads the registers of all scan lists in one transfer, which also refreshes
+ * the shadow copy, and posts the scan lists whose registers changed since the previous cycle.
+ * All scan lists are posted on the first successful cycle.
+ *
+ * @param	*arg	:	A pointer to the device
+ * @return	NULL
+ */
+static void*
+poller(void *arg)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	count;
+	uint64_t	registers;
+	uint64_t	changed;
+	uint64_t	known	=	0;
+	uint16_t	last[REGISTER_COUNT];
+	access_t	accesses[REGISTER_COUNT];
+	scan_t		scans[NUMBER_OF_SCANS];
+	uint32_t	scanCount;
+	device_t	*device	=	(device_t*)arg;
+
+	for (;;)
+	{
+		usleep(device->pollPeriod * 1000);
+		if (!device->online)
+			continue;
+
+		/*Read the registers of all scan lists*/
+		lock(device);
+		scanCount	=	device->scanCount;
+		memcpy(scans, device->scans, scanCount * sizeof(scan_t));
+		registers	=	0;
+		for (i = 0; i < scanCount; i++)
+			registers	|=	scans[i].registers;
+		for (i = 0, count = 0; i < REGISTER_COUNT; i++)
+			if (registers & (1ULL << i))
+				accesses[count++]	=	(access_t){ACCESS_READ, false, i << 1, 0x0000};
+		status	=	count ? transfer(device, accesses, count) : -1;
+		pthread_mutex_unlock(&device->mutex);
+		if (status < 0)
+			continue;
+
+		/*Find the registers that changed*/
+		changed	=	0;
+		for (i = 0; i < count; i++)
+		{
+			registers	=	1ULL << (accesses[i].reg >> 1);
+			if (!(known & registers) || last[accesses[i].reg >> 1] != accesses[i].data)
+				changed	|=	registers;
+			last[accesses[i].reg >> 1]	=	accesses[i].data;
+			known	|=	registers;
+		}
+
+		/*Post the scan lists*/
+		for (i = 0; i < scanCount; i++)
+			if (scans[i].registers & changed)
+				scanIoRequest(scans[i].scan);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Detects device resets
+ *
+ * Once per period, reads the firmware version and the plain registers, see snapshotRegisters, in
+ * one transfer. A new firmware version, or a register back on its power-on value although the IOC
+ * last wrote another one to it, means that the device was reset, and its state is replayed, see
+ * resync(). A register the IOC left on its power-on value tells nothing, so a reset goes unnoticed
+ * while every plain register is.
+ * A state that could not be restored is replayed again on the next beat.
+ * A device that does not answer is simply checked again on the next beat.
+ *
+ * @param	*arg	:	A pointer to the device
+ * @return	NULL
+ */
+static void*
+heartbeat(void *arg)
+{
+	int32_t		status;
+	uint32_t	i;
+	uint32_t	index;
+	bool		reset;
+	access_t	accesses[1 + SNAPSHOT_REGISTERS];
+	device_t	*device	=	(device_t*)arg;
 
-	for (retries = 0; retries < NUMBER_OF_RETRIES; retries++)
+	for (;;)
 	{
-		/*Write to device*/
-		status	=	write(device->socket, &message, sizeof(message));
-		if (status == sizeof(message))
-		{
-			/*Prepare poll structure*/
-			events[0].fd		=	device->socket;	
-			events[0].events	=	POLLIN;
-			events[0].revents	=	0;
+		usleep((device->heartbeatPeriod ? device->heartbeatPeriod : HEARTBEAT_PERIOD) * 1000);
+		if (!device->heartbeatPeriod || !device->online)
+			continue;
 
-			/*Poll*/
-			status	=	poll(events, 1, 1000);
-			if (status > 0) /*Ready to read (no errors or timeouts)*/
-			{
-				/*Read from device*/
-				status	=	read(device->socket, &message, sizeof(message));
-				if (status == sizeof(message))
-					break;
-			}
-		}
-	}
+		lock(device);
 
-	if (retries >= NUMBER_OF_RETRIES)
-		return -1;
+		/*Read the firmware version and the plain registers*/
+		accesses[0]	=	(access_t){ACCESS_READ, false, REGISTER_FIRMWARE, 0x0000};
+		for (i = 0; i < SNAPSHOT_REGISTERS; i++)
+			accesses[i + 1]	=	(access_t){ACCESS_READ, false, snapshotRegisters[i], 0x0000};
+		status	=	transfer(device, accesses, 1 + SNAPSHOT_REGISTERS);
 
-	/*Extract data*/
-	*data	=	ntohs(message.data);
+		/*Check them against the firmware seen before and the settings of the IOC*/
+		reset	=	device->reset || (device->firmware && accesses[0].data != device->firmware);
+		for (i = 0; i < SNAPSHOT_REGISTERS; i++)
+		{
+			index	=	(snapshotRegisters[i] >> 1) % REGISTER_COUNT;
+			if ((device->settingsValid & REGISTER_BIT(snapshotRegisters[i])) && device->settings[index] != powerOnValues[i] && accesses[i + 1].data == powerOnValues[i])
+				reset	=	true;
+		}
+		if (status == 0)
+			device->firmware	=	accesses[0].data;
+		if (status == 0 && reset)
+		{
+			printf("\x1B[31m[evg][heartbeat] %s was reset, restoring its state\n\x1B[0m", device->name);
+			device->stats.resets++;
+			device->reset	=	resync(device) < 0;
+			if (device->reset)
+				printf("\x1B[31m[evg][heartbeat] Couldn't restore the state of %s, retrying on the next beat\n\x1B[0m", device->name);
+		}
 
-	return 0;
+		pthread_mutex_unlock(&device->mutex);
+	}
+
+	return NULL;
 }
 
 /**
- * @brief	Writes device's 16-bit register
+ * @brief	Brings a device that was reset back to the state set by the IOC
  *
- * Prepares UDP message, sends it to device, and reads back reply.
- * Times out and retransmits upon detecting any communication failures.
+ * Reconnects both sockets, dropping whatever the old ones had queued along with the priority writes
+ * still waiting for their acknowledgement, and probes the device again.
+ * Then writes in one pipelined transfer the valid words of the image of both sequencers, the counter
+ * prescalers, and the registers last written by the IOC, the control register last.
+ * Selector registers are not replayed. The shadow copy is then read again and, unless under
+ * VERIFY_NEVER, the registers and the sequencer RAM are checked against what was written.
+ * Must be called with the device mutex held.
  *
- * @param	*dev	:	A pointer to the device being acted upon
- * @param	reg		:	Address of register to be read
- * @param	data	:	16-bit data to be written to device
- * @return	0 on success, -1 on failure
+ * @param	*device	:	A pointer to the device
+ * @return	0 on success, -1 on failure or mismatch
  */
 static long
-writereg(void *dev, evgregister_t reg, uint16_t data)
+resync(device_t *device)
 {
-	int32_t			status;
-	uint32_t		retries;
-	message_t		message;
-	device_t		*device	=	(device_t*)dev;
-	struct pollfd	events[1];
+	int32_t				status;
+	uint32_t			i;
+	uint32_t			n			=	0;
+	uint32_t			slots		=	0;
+	uint32_t			registers	=	0;
+	uint32_t			address;
+	uint32_t			field;
+	uint8_t				sequencer;
+	uint64_t			replayed;
+	access_t			*writes;
+	const evgregister_t	*regs;
+
+	/*Reconnect, giving up on the priority writes sent before the reset*/
+	if (reconnect(device, device->socket) < 0)
+		return -1;
+	pthread_mutex_lock(&device->laneMutex);
+	status	=	reconnect(device, device->laneSocket);
+	device->laneStats.unconfirmed	+=	device->laneCount;
+	device->laneCount	=	0;
+	pthread_cond_broadcast(&device->laneCondition);
+	pthread_mutex_unlock(&device->laneMutex);
+	if (status < 0)
+		return -1;
 
-	if (!dev)
+	/*Select the transport mode again, the firmware may have changed*/
+	status	=	probe(device);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][resync] Unable to probe %s\n\x1B[0m", device->name);
 		return -1;
+	}
 
-	/*Prepare message*/
-	message.access		=	ACCESS_WRITE;
-	message.status		=	0;
-	message.data		=	htons(data);
-	message.address		=	htonl(REGISTER_BASE_ADDRESS + reg);
-	message.reference	=	0x00000000;
+	writes	=	malloc((NUMBER_OF_SEQUENCERS * NUMBER_OF_ADDRESSES * (SLOT_FIELDS + 1) + 4 * NUMBER_OF_COUNTERS + REGISTER_COUNT) * sizeof(access_t));
+	if (!writes)
+	{
+		printf("\x1B[31m[evg][resync] Unable to allocate memory\n\x1B[0m");
+		return -1;
+	}
 
-	/*Transmit and retry*/
-	for (retries = 0; retries < NUMBER_OF_RETRIES; retries++)
+	/*Sequencer RAM*/
+	for (sequencer = 0; sequencer < NUMBER_OF_SEQUENCERS; sequencer++)
 	{
-		/*Write to device*/
-		status	=	write(device->socket, &message, sizeof(message));
-		if (status == sizeof(message))
+		regs	=	sequencerRegisters[sequencer].slot;
+		for (address = 0; address < NUMBER_OF_ADDRESSES; address++)
 		{
-			/*Prepare poll structure*/
-			events[0].fd		=	device->socket;	
-			events[0].events	=	POLLIN;
-			events[0].revents	=	0;
+			if (!device->imageValid[sequencer][address])
+				continue;
+			writes[n++]	=	(access_t){ACCESS_WRITE, false, regs[0], address};
+			for (field = 0; field < SLOT_FIELDS; field++)
+				if (device->imageValid[sequencer][address] & (1 << field))
+					writes[n++]	=	(access_t){ACCESS_WRITE, true, regs[field + 1], device->image[sequencer][address][field]};
+			slots++;
+		}
+	}
+
+	/*Counter prescalers*/
+	for (i = 0; i < 2 * NUMBER_OF_COUNTERS; i++)
+	{
+		if (!(device->counterValid & (1 << i)))
+			continue;
+		writes[n++]	=	(access_t){ACCESS_WRITE, false, REGISTER_MXC_CONTROL, (i / 2) | (i & 1 ? MXC_CONTROL_HIGH_WORD : 0)};
+		writes[n++]	=	(access_t){ACCESS_WRITE, true, REGISTER_MXC_PRESCALER, device->counterSettings[i]};
+	}
+
+	/*Registers, the control register last*/
+	replayed	=	device->settingsValid & SHADOW_REGISTERS & ~SELECTOR_REGISTERS & ~REGISTER_BIT(REGISTER_FIRMWARE);
+	for (i = 0; i < REGISTER_COUNT; i++)
+	{
+		if (!(replayed & (1ULL << i)) || (i << 1) == REGISTER_CONTROL)
+			continue;
+		writes[n++]	=	(access_t){ACCESS_WRITE, false, i << 1, device->settings[i]};
+		registers++;
+	}
+	if (replayed & REGISTER_BIT(REGISTER_CONTROL))
+	{
+		writes[n++]	=	(access_t){ACCESS_WRITE, false, REGISTER_CONTROL, device->settings[REGISTER_CONTROL >> 1]};
+		registers++;
+	}
+
+	status	=	transfer(device, writes, n);
+	free(writes);
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][resync] Couldn't write the state of %s\n\x1B[0m", device->name);
+		return -1;
+	}
 
-			/*Poll*/
-			status	=	poll(events, 1, 1000);
-			if (status > 0)
+	/*Read the registers again and check what was written*/
+	status	=	refresh(device);
+	if (status < 0)
+		return -1;
+	if (device->verify != VERIFY_NEVER)
+	{
+		for (i = 0; i < REGISTER_COUNT; i++)
+		{
+			if ((replayed & (1ULL << i)) && device->shadow[i] != device->settings[i])
 			{
-				/*Read from device*/
-				status	=	read(device->socket, &message, sizeof(message));
-				if (status == sizeof(message))
-					break;
+				printf("\x1B[31m[evg][resync] Register 0x%02x of %s holds 0x%04x, 0x%04x was written\n\x1B[0m", i << 1, device->name, device->shadow[i], device->settings[i]);
+				status	=	-1;
 			}
 		}
+		for (sequencer = 0; sequencer < NUMBER_OF_SEQUENCERS; sequencer++)
+			if (checkSlots(device, sequencer, 0, NUMBER_OF_ADDRESSES, false) != 0)
+				status	=	-1;
 	}
 
-	if (retries >= NUMBER_OF_RETRIES)
+	printf("[evg][resync] %s: replayed %u slots and %u registers\n", device->name, slots, registers);
+
+	return status;
+}
+
+/**
+ * @brief	Replaces a socket of a device with a new one
+ *
+ * The new socket is connected to the device and takes over the descriptor of the old one,
+ * so that threads polling that descriptor carry on with the new socket. Whatever was queued
+ * on the old socket is dropped.
+ *
+ * @param	*device		:	A pointer to the device
+ * @param	descriptor	:	Descriptor of the socket to be replaced
+ * @return	0 on success, -1 on failure
+ */
+static long
+reconnect(device_t *device, int32_t descriptor)
+{
+	int32_t				replacement;
+	struct sockaddr_in	peer;
+
+	memset((uint8_t *)&peer, 0, sizeof(peer));
+	peer.sin_family			=	AF_INET;
+	peer.sin_port			=	device->port;
+	peer.sin_addr.s_addr	=	device->ip;
+	replacement	=	socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (replacement < 0 || connect(replacement, (struct sockaddr*)&peer, sizeof(peer)) < 0 || dup2(replacement, descriptor) < 0)
+	{
+		printf("\x1B[31m[evg][reconnect] Unable to reconnect to %s\n\x1B[0m", device->name);
+		if (replacement >= 0)
+			close(replacement);
 		return -1;
+	}
+	close(replacement);
 
 	return 0;
 }
@@ -1778,8 +6915,10 @@ report(int detail)
 	for (i = 0; i < deviceCount; i++)
 	{
 		printf("===Start of EVG Device Report===\n");
-		address.s_addr	=	devices[i].ip;
-		printf("Found %s @ %s:%u\n", devices[i].name, inet_ntoa(address), ntohs(devices[i].port));
+		address.s_addr	=	devices[i]->ip;
+		printf("Found %s @ %s:%u, %s\n", devices[i]->name, inet_ntoa(address), ntohs(devices[i]->port), devices[i]->online ? "online" : "offline");
+		if (detail > 0 && devices[i]->connected)
+			statsPrint(devices[i], detail);
 	}
 		printf("===End of EVG Device Report===\n\n");
 
@@ -1805,15 +6944,17 @@ static 	long	configure(char *name, char *ip, char* port, char* frequency)
 {
 	struct	hostent *hostentry;
 	struct	in_addr **addr_list;
+	device_t	*device;
+	device_t	**list;
 
-	if (deviceCount >= NUMBER_OF_DEVICES)
+	if (!name || !strlen(name) || strlen(name) >= NAME_LENGTH)
 	{
-		errlogPrintf("\x1B[31mUnable to configure device: Too many devices\r\n\x1B[0m");
+		errlogPrintf("\x1B[31mUnable to configure device: Missing or incorrect name\r\n\x1B[0m");
 		return -1;
 	}
-	if (!name || !strlen(name) || strlen(name) >= NAME_LENGTH)
+	if (evg_open(name))
 	{
-		errlogPrintf("\x1B[31mUnable to configure device: Missing or incorrect name\r\n\x1B[0m");
+		errlogPrintf("\x1B[31mUnable to configure device: Device already configured\r\n\x1B[0m");
 		return -1;
 	}
 	if (!ip)
@@ -1840,16 +6981,49 @@ static 	long	configure(char *name, char *ip, char* port, char* frequency)
 	}
 	addr_list = (struct in_addr **) hostentry->h_addr_list;
 
+	/*Allocate device*/
+	list	=	realloc(devices, (deviceCount + 1) * sizeof(device_t*));
+	if (!list)
+	{
+		errlogPrintf("\x1B[31mUnable to configure device: Unable to allocate memory\r\n\x1B[0m");
+		return -1;
+	}
+	devices	=	list;
+	device	=	calloc(1, sizeof(device_t));
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to configure device: Unable to allocate memory\r\n\x1B[0m");
+		return -1;
+	}
+
 	if (addr_list[0] != NULL)
-		devices[deviceCount].ip = inet_addr(inet_ntoa(*addr_list[0]));
+		device->ip = inet_addr(inet_ntoa(*addr_list[0]));
 	else
-		devices[deviceCount].ip	= inet_addr(ip);
-
-	strcpy(devices[deviceCount].name, 	name);
-	devices[deviceCount].port	=	htons(atoi(port));
-	devices[deviceCount].frequency	=	atoi(frequency);
-
-	deviceCount++;
+		device->ip	= inet_addr(ip);
+
+	strcpy(device->name, 	name);
+	device->port		=	htons(atoi(port));
+	device->frequency	=	atoi(frequency);
+	device->reference	=	1;
+	device->window		=	1;
+	device->tagged		=	false;
+	device->records		=	1;
+	device->verify		=	VERIFY_ALWAYS;
+	device->pollPeriod	=	POLL_PERIOD;
+	device->heartbeatPeriod	=	HEARTBEAT_PERIOD;
+	device->rto			=	TIMEOUT * 1000;
+	device->rtoFloor	=	RTO_FLOOR * 1000;
+	device->rtoCeiling	=	RTO_CEILING * 1000;
+
+	pthread_mutex_init(&device->mutex, NULL);
+	pthread_mutex_init(&device->laneMutex, NULL);
+	pthread_cond_init(&device->laneCondition, NULL);
+	pthread_cond_init(&device->drained, NULL);
+	devices[deviceCount++]	=	device;
+
+	/*Add it to the name hash table*/
+	device->chain			=	deviceTable[hash(name)];
+	deviceTable[hash(name)]	=	device;
 
 	return 0;
 }
@@ -1859,9 +7033,443 @@ static void configureFunc (const iocshArgBuf *args)
     configure(args[0].sval, args[1].sval, args[2].sval, args[3].sval);
 }
 
+static 	const 	iocshArg		refreshArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg*		refreshArgs[] = 
+{
+    &refreshArg0,
+};
+static	const	iocshFuncDef	refreshDef	=	{ "evgRefresh", 1, refreshArgs };
+static void refreshFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to refresh device: Device not found\r\n\x1B[0m");
+		return;
+	}
+	evg_refresh(device);
+}
+
+static 	const 	iocshArg		verifyArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		verifyArg1 	= 	{ "policy",		iocshArgString };
+static 	const 	iocshArg*		verifyArgs[] = 
+{
+    &verifyArg0,
+    &verifyArg1,
+};
+static	const	iocshFuncDef	verifyDef	=	{ "evgSetVerify", 2, verifyArgs };
+static void verifyFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set verification policy: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+		errlogPrintf("\x1B[31mUnable to set verification policy: Missing policy\r\n\x1B[0m");
+	else if (strcmp(args[1].sval, "always") == 0)
+		evg_setVerify(device, VERIFY_ALWAYS);
+	else if (strcmp(args[1].sval, "never") == 0)
+		evg_setVerify(device, VERIFY_NEVER);
+	else if (strcmp(args[1].sval, "deferred") == 0)
+		evg_setVerify(device, VERIFY_DEFERRED);
+	else
+		errlogPrintf("\x1B[31mUnable to set verification policy: Policy must be always, never or deferred\r\n\x1B[0m");
+}
+
+static 	const 	iocshArg		statsArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		statsArg1 	= 	{ "reset",		iocshArgString };
+static 	const 	iocshArg*		statsArgs[] = 
+{
+    &statsArg0,
+    &statsArg1,
+};
+static	const	iocshFuncDef	statsDef	=	{ "evgStats", 2, statsArgs };
+static void statsFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to print statistics: Device not found\r\n\x1B[0m");
+		return;
+	}
+	statsPrint(device, 2);
+	if (args[1].sval && strcmp(args[1].sval, "reset") == 0)
+		evg_resetStatistics(device);
+}
+
+static 	const 	iocshArg		timeoutArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		timeoutArg1 	= 	{ "floor",		iocshArgString };
+static 	const 	iocshArg		timeoutArg2 	= 	{ "ceiling",	iocshArgString };
+static 	const 	iocshArg*		timeoutArgs[] = 
+{
+    &timeoutArg0,
+    &timeoutArg1,
+    &timeoutArg2,
+};
+static	const	iocshFuncDef	timeoutDef	=	{ "evgSetTimeout", 3, timeoutArgs };
+static void timeoutFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set timeout: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval || !args[2].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to set timeout: Missing floor or ceiling\r\n\x1B[0m");
+		return;
+	}
+	evg_setTimeout(device, atoi(args[1].sval), atoi(args[2].sval));
+}
+
+static 	const 	iocshArg		pollArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		pollArg1 	= 	{ "period",		iocshArgString };
+static 	const 	iocshArg*		pollArgs[] = 
+{
+    &pollArg0,
+    &pollArg1,
+};
+static	const	iocshFuncDef	pollDef	=	{ "evgSetPollPeriod", 2, pollArgs };
+static void pollFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set poll period: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to set poll period: Missing period\r\n\x1B[0m");
+		return;
+	}
+	evg_setPollPeriod(device, atoi(args[1].sval));
+}
+
+static 	const 	iocshArg		ageArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		ageArg1 	= 	{ "age",		iocshArgString };
+static 	const 	iocshArg*		ageArgs[] = 
+{
+    &ageArg0,
+    &ageArg1,
+};
+static	const	iocshFuncDef	ageDef	=	{ "evgSetReadAge", 2, ageArgs };
+static void ageFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set read age: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to set read age: Missing age\r\n\x1B[0m");
+		return;
+	}
+	evg_setReadAge(device, atoi(args[1].sval));
+}
+
+static 	const 	iocshArg		deadlineArg0 	= 	{ "deadline",	iocshArgString };
+static 	const 	iocshArg*		deadlineArgs[] = 
+{
+    &deadlineArg0,
+};
+static	const	iocshFuncDef	deadlineDef	=	{ "evgSetStartupDeadline", 1, deadlineArgs };
+static void deadlineFunc (const iocshArgBuf *args)
+{
+	if (!args[0].sval || !atoi(args[0].sval))
+	{
+		errlogPrintf("\x1B[31mUnable to set startup deadline: Missing or incorrect deadline\r\n\x1B[0m");
+		return;
+	}
+	startupDeadline	=	atoi(args[0].sval);
+}
+
+static 	const 	iocshArg		loadArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		loadArg1 	= 	{ "sequencer",	iocshArgString };
+static 	const 	iocshArg		loadArg2 	= 	{ "file",		iocshArgString };
+static 	const 	iocshArg*		loadArgs[] = 
+{
+    &loadArg0,
+    &loadArg1,
+    &loadArg2,
+};
+static	const	iocshFuncDef	loadDef	=	{ "evgLoadSequence", 3, loadArgs };
+static void loadFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to load sequence: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval || !args[2].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to load sequence: Missing sequencer or file\r\n\x1B[0m");
+		return;
+	}
+	evg_loadSequenceFile(device, atoi(args[1].sval), args[2].sval);
+}
+
+static 	const 	iocshArg		defineArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		defineArg1 	= 	{ "sequence",	iocshArgString };
+static 	const 	iocshArg		defineArg2 	= 	{ "file",		iocshArgString };
+static 	const 	iocshArg*		defineArgs[] = 
+{
+    &defineArg0,
+    &defineArg1,
+    &defineArg2,
+};
+static	const	iocshFuncDef	defineDef	=	{ "evgDefineSequence", 3, defineArgs };
+static void defineFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to define sequence: Device not found\r\n\x1B[0m");
+		return;
+	}
+	evg_defineSequence(device, args[1].sval, args[2].sval);
+}
+
+static 	const 	iocshArg		gatherArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		gatherArg1 	= 	{ "window",		iocshArgString };
+static 	const 	iocshArg*		gatherArgs[] = 
+{
+    &gatherArg0,
+    &gatherArg1,
+};
+static	const	iocshFuncDef	gatherDef	=	{ "evgSetGatherWindow", 2, gatherArgs };
+static void gatherFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set gather window: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to set gather window: Missing window\r\n\x1B[0m");
+		return;
+	}
+	evg_setGatherWindow(device, atoi(args[1].sval));
+}
+
+static 	const 	iocshArg		auditArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		auditArg1 	= 	{ "period",		iocshArgString };
+static 	const 	iocshArg*		auditArgs[] = 
+{
+    &auditArg0,
+    &auditArg1,
+};
+static	const	iocshFuncDef	auditDef	=	{ "evgSetAuditPeriod", 2, auditArgs };
+static void auditFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set audit period: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to set audit period: Missing period\r\n\x1B[0m");
+		return;
+	}
+	evg_setAuditPeriod(device, atoi(args[1].sval));
+}
+
+/*Operations issued to every device by the iocsh commands below*/
+typedef struct
+{
+	uint8_t		sequencer;
+	const char	*path;
+} loadall_t;
+static long enableOperation (void *device, void *arg)
+{
+	return evg_enable(device, *(bool*)arg);
+}
+static long loadOperation (void *device, void *arg)
+{
+	return evg_loadSequenceFile(device, ((loadall_t*)arg)->sequencer, ((loadall_t*)arg)->path);
+}
+
+static 	const 	iocshArg		enableAllArg0 	= 	{ "enable",		iocshArgString };
+static 	const 	iocshArg*		enableAllArgs[] = 
+{
+    &enableAllArg0,
+};
+static	const	iocshFuncDef	enableAllDef	=	{ "evgEnableAll", 1, enableAllArgs };
+static void enableAllFunc (const iocshArgBuf *args)
+{
+	bool	enable;
+
+	if (!args[0].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to enable devices: Missing enable\r\n\x1B[0m");
+		return;
+	}
+	enable	=	atoi(args[0].sval) != 0;
+	if (evg_fanout(NULL, 0, enableOperation, &enable, NULL) < 0)
+		errlogPrintf("\x1B[31mUnable to enable every device\r\n\x1B[0m");
+}
+
+static 	const 	iocshArg		loadAllArg0 	= 	{ "sequencer",	iocshArgString };
+static 	const 	iocshArg		loadAllArg1 	= 	{ "file",		iocshArgString };
+static 	const 	iocshArg*		loadAllArgs[] = 
+{
+    &loadAllArg0,
+    &loadAllArg1,
+};
+static	const	iocshFuncDef	loadAllDef	=	{ "evgLoadSequenceAll", 2, loadAllArgs };
+static void loadAllFunc (const iocshArgBuf *args)
+{
+	loadall_t	load;
+
+	if (!args[0].sval || !args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to load sequence: Missing sequencer or file\r\n\x1B[0m");
+		return;
+	}
+	load.sequencer	=	atoi(args[0].sval);
+	load.path		=	args[1].sval;
+	if (evg_fanout(NULL, 0, loadOperation, &load, NULL) < 0)
+		errlogPrintf("\x1B[31mUnable to load sequence into every device\r\n\x1B[0m");
+}
+
+static 	const 	iocshArg		heartbeatArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		heartbeatArg1 	= 	{ "period",		iocshArgString };
+static 	const 	iocshArg*		heartbeatArgs[] = 
+{
+    &heartbeatArg0,
+    &heartbeatArg1,
+};
+static	const	iocshFuncDef	heartbeatDef	=	{ "evgSetHeartbeatPeriod", 2, heartbeatArgs };
+static void heartbeatFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to set heartbeat period: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to set heartbeat period: Missing period\r\n\x1B[0m");
+		return;
+	}
+	evg_setHeartbeatPeriod(device, atoi(args[1].sval));
+}
+
+static 	const 	iocshArg		snapshotArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		snapshotArg1 	= 	{ "file",		iocshArgString };
+static 	const 	iocshArg*		snapshotArgs[] = 
+{
+    &snapshotArg0,
+    &snapshotArg1,
+};
+static	const	iocshFuncDef	snapshotDef	=	{ "evgSnapshot", 2, snapshotArgs };
+static void snapshotFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to take snapshot: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to take snapshot: Missing file\r\n\x1B[0m");
+		return;
+	}
+	evg_snapshot(device, args[1].sval);
+}
+
+static 	const 	iocshArg		restoreArg0 	= 	{ "name",		iocshArgString };
+static 	const 	iocshArg		restoreArg1 	= 	{ "file",		iocshArgString };
+static 	const 	iocshArg*		restoreArgs[] = 
+{
+    &restoreArg0,
+    &restoreArg1,
+};
+static	const	iocshFuncDef	restoreDef	=	{ "evgRestore", 2, restoreArgs };
+static void restoreFunc (const iocshArgBuf *args)
+{
+	void	*device	=	evg_open(args[0].sval);
+
+	if (!device)
+	{
+		errlogPrintf("\x1B[31mUnable to restore snapshot: Device not found\r\n\x1B[0m");
+		return;
+	}
+	if (!args[1].sval)
+	{
+		errlogPrintf("\x1B[31mUnable to restore snapshot: Missing file\r\n\x1B[0m");
+		return;
+	}
+	evg_restore(device, args[1].sval);
+}
+
+static 	const 	iocshArg		simulateArg0 	= 	{ "port",		iocshArgString };
+static 	const 	iocshArg		simulateArg1 	= 	{ "latency",	iocshArgString };
+static 	const 	iocshArg		simulateArg2 	= 	{ "jitter",		iocshArgString };
+static 	const 	iocshArg		simulateArg3 	= 	{ "loss",		iocshArgString };
+static 	const 	iocshArg*		simulateArgs[] = 
+{
+    &simulateArg0,
+    &simulateArg1,
+    &simulateArg2,
+    &simulateArg3,
+};
+static	const	iocshFuncDef	simulateDef	=	{ "evgSimulate", 4, simulateArgs };
+static void simulateFunc (const iocshArgBuf *args)
+{
+	if (!args[0].sval || !atoi(args[0].sval) || atoi(args[0].sval) > USHRT_MAX)
+	{
+		errlogPrintf("\x1B[31mUnable to start simulator: Missing or incorrect port\r\n\x1B[0m");
+		return;
+	}
+	if (evg_simulate(atoi(args[0].sval), args[1].sval ? atoi(args[1].sval) : 0, args[2].sval ? atoi(args[2].sval) : 0, args[3].sval ? atof(args[3].sval) : 0) < 0)
+		errlogPrintf("\x1B[31mUnable to start simulator\r\n\x1B[0m");
+}
+
 static void evgRegister(void)
 {
 	iocshRegister(&configureDef, configureFunc);
+	iocshRegister(&refreshDef, refreshFunc);
+	iocshRegister(&verifyDef, verifyFunc);
+	iocshRegister(&statsDef, statsFunc);
+	iocshRegister(&timeoutDef, timeoutFunc);
+	iocshRegister(&pollDef, pollFunc);
+	iocshRegister(&ageDef, ageFunc);
+	iocshRegister(&deadlineDef, deadlineFunc);
+	iocshRegister(&loadDef, loadFunc);
+	iocshRegister(&defineDef, defineFunc);
+	iocshRegister(&auditDef, auditFunc);
+	iocshRegister(&gatherDef, gatherFunc);
+	iocshRegister(&enableAllDef, enableAllFunc);
+	iocshRegister(&loadAllDef, loadAllFunc);
+	iocshRegister(&simulateDef, simulateFunc);
+	iocshRegister(&snapshotDef, snapshotFunc);
+	iocshRegister(&restoreDef, restoreFunc);
+	iocshRegister(&heartbeatDef, heartbeatFunc);
 }
 
 /*
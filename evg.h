@@ -29,6 +29,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/*EPICS headers*/
+#include <dbScan.h>
+
 /**
  * @brief	VME-MRF-230/RF Register addresses
  */
@@ -77,6 +80,16 @@ typedef enum
 #define ACCESS_READ		(1)
 #define ACCESS_WRITE	(2)
 
+/** @brief message_t is a structure that represents the UDP message sent/received to/from the device, in network byte-order*/
+typedef struct
+{
+	uint8_t		access;		/*Read/Write*/
+	uint8_t		status;		/*Filled by device*/
+	uint16_t	data;		/*Register data*/
+	uint32_t	address;	/*Register address*/
+	uint32_t	reference;	/*Request tag, echoed by the device*/
+} message_t;
+
 /*Device name maximum length*/
 #define NAME_LENGTH				30
 /*evg register base address*/
@@ -106,7 +119,38 @@ typedef enum
 	TRIGGER_AC
 } triggersource_t;
 
+typedef enum
+{
+	VERIFY_ALWAYS,
+	VERIFY_NEVER,
+	VERIFY_DEFERRED
+} verify_t;
+
+/** @brief timeunit_t is the unit of the times of a sequence, converted to ticks of the sequencer clock */
+typedef enum
+{
+	TIME_TICKS,
+	TIME_NANOSECONDS,
+	TIME_MICROSECONDS
+} timeunit_t;
+
+/**
+ * @brief	evgrequest_t is an IO request carried out by the device worker thread
+ *
+ * Requests queued within the gather window of the device are carried out together, their writes
+ * going out in one transfer, and complete is called for each of them once the transfer is done.
+ */
+typedef struct
+{
+	void	(*function)	(void *arg);	/*Function that performs the IO*/
+	void	*arg;						/*Argument passed to function*/
+	const char	*name;					/*Name of the request, used for statistics*/
+	void	(*complete)	(void *arg, long status);	/*Called with arg once the IO is carried out, status is -1 if it failed, may be NULL*/
+} evgrequest_t;
+
 void*	evg_open						(char *name);
+long	evg_queue						(void* device, evgrequest_t *request);
+long	evg_fanout						(void** devices, uint32_t count, long (*operation)(void *device, void *arg), void *arg, long *results);
 long	evg_enable						(void* device, bool enable);
 long	evg_isEnabled					(void* device);
 long	evg_setClock					(void* device, uint16_t frequency);
@@ -126,13 +170,50 @@ long	evg_getSequencerTriggerSource	(void* device, uint8_t sequencer, triggersour
 long	evg_setSequencerPrescaler		(void* device, uint8_t sequencer, uint16_t prescaler);
 long	evg_getSequencerPrescaler		(void* device, uint8_t sequencer, uint16_t *prescaler);
 long	evg_triggerSequencer			(void* device, uint8_t sequencer);
+long	evg_laneTrigger					(void* device, uint8_t sequencer);
 long	evg_setEvent					(void* device, uint8_t sequencer, uint16_t address, uint8_t event);
 long	evg_getEvent					(void* device, uint8_t sequencer, uint16_t address, uint8_t *event);
 long	evg_setTimestamp				(void* device, uint8_t sequencer, uint16_t address, uint32_t timestamp);
 long	evg_getTimestamp				(void* device, uint8_t sequencer, uint16_t address, uint32_t *timestamp);
+long	evg_loadSequence				(void* device, uint8_t sequencer, const uint8_t *events, const uint32_t *timestamps, uint16_t count);
+long	evg_loadSequences				(void* device, const uint8_t **events, const uint32_t **timestamps, const uint16_t *counts);
+long	evg_stageSequence				(void* device, uint8_t sequencer, const uint8_t *events, const uint32_t *timestamps, uint16_t count);
+long	evg_commitSequence				(void* device, uint8_t sequencer);
+long	evg_readSequence				(void* device, uint8_t sequencer, uint8_t *events, uint32_t *timestamps, uint16_t count);
+long	evg_applySequence				(void* device, uint8_t sequencer, const uint8_t *events, const uint32_t *timestamps, uint16_t count);
+long	evg_readSlots					(void* device, uint8_t sequencer, uint16_t first, uint8_t *events, uint32_t *timestamps, uint16_t count);
+long	evg_applySlots					(void* device, uint8_t sequencer, uint16_t first, const uint8_t *events, const uint32_t *timestamps, uint16_t count);
+long	evg_toTicks						(void* device, uint8_t sequencer, timeunit_t unit, const double *times, uint32_t *timestamps, uint16_t count);
+long	evg_fromTicks					(void* device, uint8_t sequencer, timeunit_t unit, const uint32_t *timestamps, double *times, uint16_t count);
+long	evg_loadSequenceTimes			(void* device, uint8_t sequencer, const uint8_t *events, const double *times, timeunit_t unit, uint16_t count);
+long	evg_stageSequenceTimes			(void* device, uint8_t sequencer, const uint8_t *events, const double *times, timeunit_t unit, uint16_t count);
+long	evg_readSlotTimes				(void* device, uint8_t sequencer, uint16_t first, uint8_t *events, double *times, timeunit_t unit, uint16_t count);
+long	evg_applySlotTimes				(void* device, uint8_t sequencer, uint16_t first, const uint8_t *events, const double *times, timeunit_t unit, uint16_t count);
 long	evg_setSoftwareEvent			(void* device, uint8_t event);
 long	evg_setCounterPrescaler			(void* device, uint8_t counter, uint32_t prescaler);
+long	evg_setCounterPrescalers		(void* device, const uint32_t *prescalers);
 long	evg_getCounterPrescaler			(void* device, uint8_t counter, uint32_t *prescaler);
 long	evg_getFirmwareVersion			(void* device, uint16_t *version);
+long	evg_refresh						(void* device);
+long	evg_snapshot					(void* device, const char *path);
+long	evg_restore						(void* device, const char *path);
+long	evg_setVerify					(void* device, verify_t policy);
+long	evg_verify						(void* device);
+long	evg_setTimeout					(void* device, uint32_t floor, uint32_t ceiling);
+long	evg_getStatistic				(void* device, const char *name, double *value);
+long	evg_resetStatistics				(void* device);
+long	evg_loadSequenceFile			(void* device, uint8_t sequencer, const char *path);
+long	evg_defineSequence				(void* device, const char *name, const char *path);
+long	evg_selectSequence				(void* device, uint8_t sequencer, const char *name);
+long	evg_getIoScan					(void* device, const char *command, uint8_t sequencer, IOSCANPVT *scan);
+long	evg_setPollPeriod				(void* device, uint32_t period);
+long	evg_setGatherWindow				(void* device, uint32_t window);
+long	evg_setAuditPeriod				(void* device, uint32_t period);
+long	evg_setHeartbeatPeriod			(void* device, uint32_t period);
+long	evg_setReadAge					(void* device, uint32_t age);
+long	evg_batchBegin					(void* device);
+long	evg_batchRead					(void* device, evgregister_t reg, uint16_t *data);
+long	evg_batchWrite					(void* device, evgregister_t reg, uint16_t data);
+long	evg_batchCommit					(void* device);
 
 #endif /*__EVG_H__*/
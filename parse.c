@@ -2,18 +2,119 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
 
 #include "parse.h"
 
 /*Macros*/
+#define POOL_CHUNK		64		/*Number of io_t blocks allocated at once*/
+#define CACHE_LINE		64		/*Alignment of io_t blocks in bytes*/
+#define BLOCK_SIZE		((sizeof(io_t) + CACHE_LINE - 1) & ~(CACHE_LINE - 1))
+
+/*Function prototypes*/
+static	bool	copy		(char *field, size_t size, const char *token, size_t length);
+static	long	number		(const char *token, size_t length, uint32_t maximum, uint32_t *first, uint32_t *last);
+
+/*Local variables*/
+static	char			*pool;										/*Chunk io_t blocks are handed out from*/
+static	uint32_t		poolFree;									/*Number of blocks left in the chunk*/
+static	pthread_mutex_t	poolMutex	=	PTHREAD_MUTEX_INITIALIZER;	/*Mutex for accessing the pool*/
+
+/*Names of the commands, indexed by command code*/
+static	const	char	*commands[COMMAND_COUNT]	=
+{
+	[COMMAND_ENABLE]						=	"enable",
+	[COMMAND_IS_ENABLED]					=	"isEnabled",
+	[COMMAND_SET_RF_CLOCK_SOURCE]			=	"setRfClockSource",
+	[COMMAND_GET_RF_CLOCK_SOURCE]			=	"getRfClockSource",
+	[COMMAND_SET_RF_PRESCALER]				=	"setRfPrescaler",
+	[COMMAND_GET_RF_PRESCALER]				=	"getRfPrescaler",
+	[COMMAND_SET_AC_PRESCALER]				=	"setAcPrescaler",
+	[COMMAND_GET_AC_PRESCALER]				=	"getAcPrescaler",
+	[COMMAND_SET_AC_SYNC_SOURCE]			=	"setAcSyncSource",
+	[COMMAND_GET_AC_SYNC_SOURCE]			=	"getAcSyncSource",
+	[COMMAND_ENABLE_SEQUENCER]				=	"enableSequencer",
+	[COMMAND_IS_SEQUENCER_ENABLED]			=	"isSequencerEnabled",
+	[COMMAND_SET_SEQUENCER_TRIGGER_SOURCE]	=	"setSequencerTriggerSource",
+	[COMMAND_GET_SEQUENCER_TRIGGER_SOURCE]	=	"getSequencerTriggerSource",
+	[COMMAND_SET_SEQUENCER_PRESCALER]		=	"setSequencerPrescaler",
+	[COMMAND_GET_SEQUENCER_PRESCALER]		=	"getSequencerPrescaler",
+	[COMMAND_TRIGGER_SEQUENCER]				=	"triggerSequencer",
+	[COMMAND_SET_EVENT]						=	"setEvent",
+	[COMMAND_GET_EVENT]						=	"getEvent",
+	[COMMAND_SET_TIMESTAMP]					=	"setTimestamp",
+	[COMMAND_GET_TIMESTAMP]					=	"getTimestamp",
+	[COMMAND_SET_SOFTWARE_EVENT]			=	"setSoftwareEvent",
+	[COMMAND_SET_COUNTER_PRESCALER]			=	"setCounterPrescaler",
+	[COMMAND_GET_COUNTER_PRESCALER]			=	"getCounterPrescaler",
+	[COMMAND_GET_CLOCK]						=	"getClock",
+	[COMMAND_GET_FIRMWARE_VERSION]			=	"getFirmwareVersion",
+	[COMMAND_GET_STATISTIC]					=	"getStatistic",
+	[COMMAND_GET_EVENTS]					=	"getEvents",
+	[COMMAND_GET_TIMESTAMPS]				=	"getTimestamps",
+	[COMMAND_SET_EVENTS]					=	"setEvents",
+	[COMMAND_SET_TIMESTAMPS]				=	"setTimestamps",
+	[COMMAND_STAGE_EVENTS]					=	"stageEvents",
+	[COMMAND_STAGE_TIMESTAMPS]				=	"stageTimestamps",
+	[COMMAND_COMMIT_SEQUENCE]				=	"commitSequence",
+	[COMMAND_SELECT_SEQUENCE]				=	"selectSequence",
+};
+
+/**
+ * @brief	Hands out a zeroed io_t block
+ *
+ * Blocks are carved out of chunks of POOL_CHUNK blocks, each aligned on a cache line so that
+ * records carried out by different workers never share one. Blocks live as long as the IOC.
+ *
+ * @return	Pointer to the block, NULL on failure
+ */
+io_t*
+evg_allocate(void)
+{
+	io_t	*io;
+
+	pthread_mutex_lock(&poolMutex);
+	if (!poolFree)
+	{
+		if (posix_memalign((void**)&pool, CACHE_LINE, POOL_CHUNK * BLOCK_SIZE))
+		{
+			printf("[evg][allocate] Unable to allocate memory\n");
+			pthread_mutex_unlock(&poolMutex);
+			return NULL;
+		}
+		memset(pool, 0, POOL_CHUNK * BLOCK_SIZE);
+		poolFree	=	POOL_CHUNK;
+	}
+	io		=	(io_t*)pool;
+	pool	+=	BLOCK_SIZE;
+	poolFree--;
+	pthread_mutex_unlock(&poolMutex);
+
+	return io;
+}
+
+/**
+ * @brief	Parses the INST_IO string of a record into its descriptor
+ *
+ * The string is "<device>:<command> [key=value]...", with the keys sequencer, address, counter,
+ * unit, and statistic. The address may be a range "first..last", describing a block of slots for the
+ * array device support, and the unit, one of ticks, ns, or us, is that of its timestamps. The string is read in one pass and left untouched, and every field is
+ * bound-checked, so that the parser is reentrant and never overflows.
+ *
+ * @param	*io			:	Descriptor being filled
+ * @param	*parameters	:	INST_IO string
+ * @return	0 on success, -1 on failure
+ */
 long
-evg_parse(io_t *io, char *parameters)
+evg_parse(io_t *io, const char *parameters)
 {
-	uint32_t	i;
-	char		*token;
-	char		tokens[][TOKEN_LENGTH]	=	{"", "", "", "", ""};
-	char		key		[TOKEN_LENGTH];
-	char		value	[TOKEN_LENGTH];
+	const char	*cursor;
+	const char	*key;
+	const char	*value;
+	size_t		keyLength;
+	size_t		valueLength;
+	uint32_t	last;
 
 	/*Check parameters*/
 	if (!io || !parameters)
@@ -22,69 +123,185 @@ evg_parse(io_t *io, char *parameters)
 		return -1;
 	}
 
-	/*Collect tokens*/
-	token	=	strtok(parameters, " ");
-	if (token)
-		strcpy(tokens[0], token);
-	for (i = 1; token != NULL; i++)
-	{
-		token	=	strtok(NULL, " ");
-		if (token)
-			strcpy(tokens[i], token);
-	}
-
 	/*Parse name*/
-	token	=	strtok(tokens[0], ":");
-	if (!token)
+	for (cursor = parameters; *cursor == ' '; cursor++)
+		;
+	key		=	cursor;
+	cursor	+=	strcspn(cursor, ": ");
+	if (cursor == key || *cursor != ':')
 	{
 		printf("[evg][parse] Unable to parse: Missing device name.\n");
 		return -1;
 	}
-	strcpy(io->name, token);
+	if (!copy(io->name, sizeof(io->name), key, cursor - key))
+		return -1;
 
 	/*Parse command*/
-	token	=	strtok(NULL, "");
-	if (!token)
+	key		=	++cursor;
+	cursor	+=	strcspn(cursor, " ");
+	if (cursor == key)
 	{
 		printf("[evg][parse] Unable to initialize: Missing command.\n");
 		return -1;
 	}
-	strcpy(io->command, token);
+	if (!copy(io->command, sizeof(io->command), key, cursor - key))
+		return -1;
+
+	/*Resolve command*/
+	for (io->code = COMMAND_NONE + 1; io->code < COMMAND_COUNT; io->code++)
+		if (strcmp(commands[io->code], io->command) == 0)
+			break;
+	if (io->code >= COMMAND_COUNT)
+	{
+		printf("[evg][parse] Unable to parse: Command %s is not recognized.\n", io->command);
+		return -1;
+	}
 
-	/*Parse key-value pair*/
-	for (i = 1; strlen(tokens[i]); i++)
+	/*Parse key-value pairs*/
+	for (;;)
 	{
+		for (; *cursor == ' '; cursor++)
+			;
+		if (!*cursor)
+			break;
+
 		/*Parse key*/
-		token	=	strtok(tokens[i], "=");
-		if (!token)
+		key			=	cursor;
+		keyLength	=	strcspn(cursor, "= ");
+		cursor		+=	keyLength;
+		if (!keyLength)
 		{
 			printf("[evg][parse] Unable to parse: Missing key.\r\n");
 			return -1;
 		}
-		strcpy(key, token);
 
 		/*Parse value*/
-		token	=	strtok(NULL, "");
-		if (!token)
+		if (*cursor != '=' || !cursor[1] || cursor[1] == ' ')
 		{
 			printf("[evg][parse] Unable to parse: Missing value.\r\n");
 			return -1;
 		}
-		strcpy(value, token);
+		value		=	++cursor;
+		valueLength	=	strcspn(cursor, " ");
+		cursor		+=	valueLength;
 
 		/*Process key-value pair*/
-		if (strcmp(key, "sequencer") == 0)
-			io->sequencer	=	strtol(value, NULL, 0);
-		else if (strcmp(key, "address") == 0)
-			io->address		=	strtol(value, NULL, 0);
-		else if (strcmp(key, "counter") == 0)
-			io->counter		=	strtol(value, NULL, 0);
+		if (keyLength == strlen("sequencer") && strncmp(key, "sequencer", keyLength) == 0)
+		{
+			if (number(value, valueLength, NUMBER_OF_SEQUENCERS - 1, &io->sequencer, NULL) < 0)
+				return -1;
+		}
+		else if (keyLength == strlen("address") && strncmp(key, "address", keyLength) == 0)
+		{
+			if (number(value, valueLength, NUMBER_OF_ADDRESSES - 1, &io->address, &last) < 0)
+				return -1;
+			io->count	=	last - io->address + 1;
+		}
+		else if (keyLength == strlen("counter") && strncmp(key, "counter", keyLength) == 0)
+		{
+			if (number(value, valueLength, NUMBER_OF_COUNTERS - 1, &io->counter, NULL) < 0)
+				return -1;
+		}
+		else if (keyLength == strlen("unit") && strncmp(key, "unit", keyLength) == 0)
+		{
+			if (valueLength == strlen("ticks") && strncmp(value, "ticks", valueLength) == 0)
+				io->unit	=	TIME_TICKS;
+			else if (valueLength == strlen("ns") && strncmp(value, "ns", valueLength) == 0)
+				io->unit	=	TIME_NANOSECONDS;
+			else if (valueLength == strlen("us") && strncmp(value, "us", valueLength) == 0)
+				io->unit	=	TIME_MICROSECONDS;
+			else
+			{
+				printf("[evg][parse] Unable to parse: Unit %.*s is not one of ticks, ns, us.\n", (int)valueLength, value);
+				return -1;
+			}
+		}
+		else if (keyLength == strlen("statistic") && strncmp(key, "statistic", keyLength) == 0)
+		{
+			if (!copy(io->statistic, sizeof(io->statistic), value, valueLength))
+				return -1;
+		}
 		else
 		{
-			printf("[evg][parse] Unable to parse: Key is not recognized.\n");
+			printf("[evg][parse] Unable to parse: Key %.*s is not recognized.\n", (int)keyLength, key);
 			return -1;
 		}
 	}
+
 	return 0;
 }
 
+/**
+ * @brief	Copies a token into a field of the descriptor
+ *
+ * @param	*field		:	Field being filled
+ * @param	size		:	Size of the field, including the terminating null
+ * @param	*token		:	Start of the token
+ * @param	length		:	Length of the token
+ * @return	true on success, false if the token does not fit
+ */
+static bool
+copy(char *field, size_t size, const char *token, size_t length)
+{
+	if (length >= size)
+	{
+		printf("[evg][parse] Unable to parse: %.*s is longer than %u characters.\n", (int)length, token, (uint32_t)size - 1);
+		return false;
+	}
+	memcpy(field, token, length);
+	field[length]	=	'\0';
+
+	return true;
+}
+
+/**
+ * @brief	Parses a number or, when last is not NULL, a range "first..last"
+ *
+ * @param	*token		:	Start of the token
+ * @param	length		:	Length of the token
+ * @param	maximum		:	Largest value allowed
+ * @param	*first		:	Number parsed, or first number of the range
+ * @param	*last		:	Last number of the range, first if the token is a single number, may be NULL
+ * @return	0 on success, -1 on failure
+ */
+static long
+number(const char *token, size_t length, uint32_t maximum, uint32_t *first, uint32_t *last)
+{
+	char			buffer[TOKEN_LENGTH];
+	char			*end;
+	unsigned long	value;
+
+	if (!copy(buffer, sizeof(buffer), token, length))
+		return -1;
+
+	value	=	strtoul(buffer, &end, 0);
+	if (end == buffer || value > maximum)
+	{
+		printf("[evg][parse] Unable to parse: %s is not a number up to %u.\n", buffer, maximum);
+		return -1;
+	}
+	*first	=	value;
+
+	if (last)
+	{
+		*last	=	value;
+		if (strncmp(end, "..", 2) == 0)
+		{
+			token	=	end + 2;
+			value	=	strtoul(token, &end, 0);
+			if (end == token || value > maximum || value < *first)
+			{
+				printf("[evg][parse] Unable to parse: %s is not a range up to %u.\n", buffer, maximum);
+				return -1;
+			}
+			*last	=	value;
+		}
+	}
+	if (*end)
+	{
+		printf("[evg][parse] Unable to parse: %s is not a number.\n", buffer);
+		return -1;
+	}
+
+	return 0;
+}
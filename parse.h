@@ -3,24 +3,79 @@
 
 #include <stdint.h>
 
+#include <callback.h>
+
+#include "evg.h"
+
 /*Macros*/
 #define NAME_LENGTH			30
 #define TOKEN_LENGTH		50
 
 typedef struct device_t	device_t;
 
+/** @brief command_t identifies the command of a record, resolved once by evg_parse */
+typedef enum
+{
+	COMMAND_NONE,
+	COMMAND_ENABLE,
+	COMMAND_IS_ENABLED,
+	COMMAND_SET_RF_CLOCK_SOURCE,
+	COMMAND_GET_RF_CLOCK_SOURCE,
+	COMMAND_SET_RF_PRESCALER,
+	COMMAND_GET_RF_PRESCALER,
+	COMMAND_SET_AC_PRESCALER,
+	COMMAND_GET_AC_PRESCALER,
+	COMMAND_SET_AC_SYNC_SOURCE,
+	COMMAND_GET_AC_SYNC_SOURCE,
+	COMMAND_ENABLE_SEQUENCER,
+	COMMAND_IS_SEQUENCER_ENABLED,
+	COMMAND_SET_SEQUENCER_TRIGGER_SOURCE,
+	COMMAND_GET_SEQUENCER_TRIGGER_SOURCE,
+	COMMAND_SET_SEQUENCER_PRESCALER,
+	COMMAND_GET_SEQUENCER_PRESCALER,
+	COMMAND_TRIGGER_SEQUENCER,
+	COMMAND_SET_EVENT,
+	COMMAND_GET_EVENT,
+	COMMAND_SET_TIMESTAMP,
+	COMMAND_GET_TIMESTAMP,
+	COMMAND_SET_SOFTWARE_EVENT,
+	COMMAND_SET_COUNTER_PRESCALER,
+	COMMAND_GET_COUNTER_PRESCALER,
+	COMMAND_GET_CLOCK,
+	COMMAND_GET_FIRMWARE_VERSION,
+	COMMAND_GET_STATISTIC,
+	COMMAND_GET_EVENTS,
+	COMMAND_GET_TIMESTAMPS,
+	COMMAND_SET_EVENTS,
+	COMMAND_SET_TIMESTAMPS,
+	COMMAND_STAGE_EVENTS,
+	COMMAND_STAGE_TIMESTAMPS,
+	COMMAND_COMMIT_SEQUENCE,
+	COMMAND_SELECT_SEQUENCE,
+	COMMAND_COUNT
+} command_t;
+
 typedef struct
 {
 	device_t*	device;
 	int32_t		status;
 	char		name	[NAME_LENGTH];
 	char		command	[TOKEN_LENGTH];
+	command_t	code;		/*Command resolved from its name*/
 	uint32_t	sequencer;
 	uint32_t	address;
+	uint32_t	count;		/*Number of slots from address on, 0 if no address was given*/
 	uint32_t	counter;
+	timeunit_t	unit;		/*Unit of the times of sequence arrays, ticks by default*/
+	void*		buffer;		/*Copy of the array of an array record, the only one the worker touches*/
+	uint32_t	length;		/*Number of elements in buffer*/
+	char		statistic	[TOKEN_LENGTH];
+	evgrequest_t	request;	/*Request queued to the device worker*/
+	CALLBACK		callback;	/*Callback used to complete asynchronous IO*/
 } io_t;
 
 /*Function prototypes*/
-long	evg_parse	(io_t *io, char* parameters);
+long	evg_parse		(io_t *io, const char* parameters);
+io_t*	evg_allocate	(void);
 
 #endif /*parse.h*/
@@ -0,0 +1,295 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	sequence.c
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Implements parsing of the sequence files of the VME-EVG-230/RF timing card
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "evg.h"
+#include "sequence.h"
+
+/*Macros*/
+#define LINE_LENGTH		128		/*Longest line of a text sequence file*/
+
+/*Function prototypes*/
+static	long	parseText	(FILE *file, const char *path, uint8_t *events, double *times, timeunit_t *unit, uint16_t *count);
+static	long	parseBinary	(const uint8_t *data, size_t size, const char *path, uint8_t *events, double *times, timeunit_t *unit, uint16_t *count);
+static	long	validate	(const char *path, const uint8_t *events, const double *times, uint16_t count);
+
+/**
+ * @brief	Reads a sequence file into a table of events and timestamps
+ *
+ * Binary files start with SEQUENCE_MAGIC, see sequenceentry_t. They are memory-mapped and
+ * their timestamps are taken as ticks. Any other file is read as text, one slot per line:
+ *	<event> <time>
+ * where event is a code in decimal or 0x-prefixed hex, and time is in ticks, or in nanoseconds
+ * or microseconds when suffixed with "ns" or "us". All the times of a file share one unit.
+ * The times are not converted here: the sequencer clock depends on the prescaler of the sequencer
+ * the table ends up on, see evg_toTicks.
+ * Blank lines and text following '#' are ignored.
+ * Times must increase strictly, and the last slot must hold EVENT_END_SEQUENCE.
+ *
+ * @param	*path		:	Path of the file
+ * @param	*events		:	Event codes read, NUMBER_OF_ADDRESSES at most
+ * @param	*times		:	Times read, NUMBER_OF_ADDRESSES at most
+ * @param	*unit		:	Unit of the times read
+ * @param	*count		:	Number of slots read
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_parseSequence(const char *path, uint8_t *events, double *times, timeunit_t *unit, uint16_t *count)
+{
+	int32_t		status;
+	int			descriptor;
+	void		*data;
+	FILE		*file;
+	struct stat	info;
+
+	/*Check inputs*/
+	if (!path || !events || !times || !unit || !count)
+	{
+		printf("[evg][parseSequence] Null pointer to path, table or count\n");
+		return -1;
+	}
+
+	descriptor	=	open(path, O_RDONLY);
+	if (descriptor < 0)
+	{
+		printf("[evg][parseSequence] Unable to open %s\n", path);
+		return -1;
+	}
+	if (fstat(descriptor, &info) < 0)
+	{
+		printf("[evg][parseSequence] Unable to stat %s\n", path);
+		close(descriptor);
+		return -1;
+	}
+
+	/*Binary file*/
+	if (info.st_size >= (off_t)(strlen(SEQUENCE_MAGIC) + sizeof(uint32_t)))
+	{
+		data	=	mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if (data == MAP_FAILED)
+		{
+			printf("[evg][parseSequence] Unable to map %s\n", path);
+			close(descriptor);
+			return -1;
+		}
+		if (memcmp(data, SEQUENCE_MAGIC, strlen(SEQUENCE_MAGIC)) == 0)
+		{
+			status	=	parseBinary(data, info.st_size, path, events, times, unit, count);
+			munmap(data, info.st_size);
+			close(descriptor);
+			return status < 0 ? -1 : validate(path, events, times, *count);
+		}
+		munmap(data, info.st_size);
+	}
+
+	/*Text file*/
+	file	=	fdopen(descriptor, "r");
+	if (!file)
+	{
+		printf("[evg][parseSequence] Unable to read %s\n", path);
+		close(descriptor);
+		return -1;
+	}
+	status	=	parseText(file, path, events, times, unit, count);
+	fclose(file);
+
+	return status < 0 ? -1 : validate(path, events, times, *count);
+}
+
+/**
+ * @brief	Reads the slots of a text sequence file
+ *
+ * @param	*file		:	File being read
+ * @param	*path		:	Path of the file, for messages
+ * @param	*events		:	Event codes read
+ * @param	*times		:	Times read
+ * @param	*unit		:	Unit of the times read
+ * @param	*count		:	Number of slots read
+ * @return	0 on success, -1 on failure
+ */
+static long
+parseText(FILE *file, const char *path, uint8_t *events, double *times, timeunit_t *unit, uint16_t *count)
+{
+	uint32_t	line;
+	long		event;
+	double		time;
+	timeunit_t	suffix;
+	char		*cursor;
+	char		*end;
+	char		buffer[LINE_LENGTH];
+
+	*count	=	0;
+	for (line = 1; fgets(buffer, sizeof(buffer), file); line++)
+	{
+		/*Strip comments and skip blank lines*/
+		cursor	=	strchr(buffer, '#');
+		if (cursor)
+			*cursor	=	'\0';
+		for (cursor = buffer; isspace((unsigned char)*cursor); cursor++)
+			;
+		if (!*cursor)
+			continue;
+
+		if (*count >= NUMBER_OF_ADDRESSES)
+		{
+			printf("[evg][parseSequence] %s:%u: More than %u slots\n", path, line, NUMBER_OF_ADDRESSES);
+			return -1;
+		}
+
+		/*Parse event*/
+		event	=	strtol(cursor, &end, 0);
+		if (end == cursor || event < 0 || event > 0xff)
+		{
+			printf("[evg][parseSequence] %s:%u: Missing or incorrect event\n", path, line);
+			return -1;
+		}
+
+		/*Parse time*/
+		cursor	=	end;
+		time	=	strtod(cursor, &end);
+		if (end == cursor || time < 0)
+		{
+			printf("[evg][parseSequence] %s:%u: Missing or incorrect time\n", path, line);
+			return -1;
+		}
+		for (cursor = end; isspace((unsigned char)*cursor); cursor++)
+			;
+		suffix	=	TIME_TICKS;
+		if (strncmp(cursor, "ns", 2) == 0)
+			suffix	=	TIME_NANOSECONDS;
+		else if (strncmp(cursor, "us", 2) == 0)
+			suffix	=	TIME_MICROSECONDS;
+		if (suffix != TIME_TICKS)
+			cursor	+=	2;
+		for (; isspace((unsigned char)*cursor); cursor++)
+			;
+		if (*cursor || (suffix == TIME_TICKS && time > UINT32_MAX))
+		{
+			printf("[evg][parseSequence] %s:%u: Incorrect time\n", path, line);
+			return -1;
+		}
+		if (*count && suffix != *unit)
+		{
+			printf("[evg][parseSequence] %s:%u: Unit of time differs from the previous slots\n", path, line);
+			return -1;
+		}
+
+		events[*count]	=	event;
+		times[*count]	=	time;
+		*unit			=	suffix;
+		(*count)++;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief	Reads the slots of a memory-mapped binary sequence file
+ *
+ * @param	*data		:	Content of the file
+ * @param	size		:	Size of the file in bytes
+ * @param	*path		:	Path of the file, for messages
+ * @param	*events		:	Event codes read
+ * @param	*times		:	Times read, in ticks
+ * @param	*unit		:	Unit of the times read, always TIME_TICKS
+ * @param	*count		:	Number of slots read
+ * @return	0 on success, -1 on failure
+ */
+static long
+parseBinary(const uint8_t *data, size_t size, const char *path, uint8_t *events, double *times, timeunit_t *unit, uint16_t *count)
+{
+	uint32_t				i;
+	uint32_t				slots;
+	const sequenceentry_t	*entries;
+
+	memcpy(&slots, data + strlen(SEQUENCE_MAGIC), sizeof(slots));
+	slots	=	ntohl(slots);
+	if (slots > NUMBER_OF_ADDRESSES)
+	{
+		printf("[evg][parseSequence] %s: More than %u slots\n", path, NUMBER_OF_ADDRESSES);
+		return -1;
+	}
+	if (size != strlen(SEQUENCE_MAGIC) + sizeof(uint32_t) + slots * sizeof(sequenceentry_t))
+	{
+		printf("[evg][parseSequence] %s: Size does not match %u slots\n", path, slots);
+		return -1;
+	}
+
+	entries	=	(const sequenceentry_t*)(data + strlen(SEQUENCE_MAGIC) + sizeof(uint32_t));
+	for (i = 0; i < slots; i++)
+	{
+		if (entries[i].reserved[0] || entries[i].reserved[1] || entries[i].reserved[2])
+		{
+			printf("[evg][parseSequence] %s: Reserved bytes of slot %u are not 0\n", path, i);
+			return -1;
+		}
+		events[i]	=	entries[i].event;
+		times[i]	=	ntohl(entries[i].timestamp);
+	}
+	*unit	=	TIME_TICKS;
+	*count	=	slots;
+
+	return 0;
+}
+
+/**
+ * @brief	Checks that a table is a well-formed sequence
+ *
+ * @param	*path		:	Path of the file, for messages
+ * @param	*events		:	Event codes
+ * @param	*times		:	Times
+ * @param	count		:	Number of slots
+ * @return	0 on success, -1 on failure
+ */
+static long
+validate(const char *path, const uint8_t *events, const double *times, uint16_t count)
+{
+	uint32_t	i;
+
+	if (!count || events[count - 1] != EVENT_END_SEQUENCE)
+	{
+		printf("[evg][parseSequence] %s: Sequence does not end with event 0x%x\n", path, EVENT_END_SEQUENCE);
+		return -1;
+	}
+	for (i = 1; i < count; i++)
+	{
+		if (times[i] <= times[i - 1])
+		{
+			printf("[evg][parseSequence] %s: Time of slot %u does not increase\n", path, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
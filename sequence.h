@@ -0,0 +1,68 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	sequence.h
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Header file for the sequence and snapshot files of the VME-EVG-230/RF timing card
+ */
+
+#ifndef __SEQUENCE_H__
+#define __SEQUENCE_H__
+
+#include <stdint.h>
+
+#include "evg.h"
+
+/*Macros*/
+#define SEQUENCE_MAGIC		"EVGS"	/*First bytes of a binary sequence file*/
+#define SNAPSHOT_MAGIC		"EVGD"	/*First bytes of a snapshot file*/
+#define SNAPSHOT_REGISTERS	7		/*Number of plain registers in a snapshot*/
+
+/**
+ * @brief sequenceentry_t is a slot of a binary sequence file, in network byte-order
+ *
+ * A binary sequence file is SEQUENCE_MAGIC, followed by the number of slots as a 32-bit
+ * integer in network byte-order, followed by the slots. Timestamps are in ticks.
+ */
+typedef struct
+{
+	uint32_t	timestamp;		/*Timestamp in ticks*/
+	uint8_t		event;			/*Event code*/
+	uint8_t		reserved[3];	/*Must be 0*/
+} sequenceentry_t;
+
+/**
+ * @brief snapshot_t is the content of a snapshot file, in network byte-order
+ *
+ * Holds the whole state of a device, see evg_snapshot. The registers are, in order: event enable,
+ * sequencer clock select 1 and 2, AC enable, RF control, microsecond divider, and control.
+ */
+typedef struct
+{
+	char			magic[4];										/*SNAPSHOT_MAGIC*/
+	uint16_t		firmware;										/*Firmware version of the device*/
+	uint16_t		registers[SNAPSHOT_REGISTERS];					/*Plain registers*/
+	uint32_t		counters[NUMBER_OF_COUNTERS];					/*Counter prescalers*/
+	sequenceentry_t	slots[NUMBER_OF_SEQUENCERS][NUMBER_OF_ADDRESSES];	/*Sequencer RAM, timestamps in ticks*/
+} snapshot_t;
+
+/*Function prototypes*/
+long	evg_parseSequence	(const char *path, uint8_t *events, double *times, timeunit_t *unit, uint16_t *count);
+
+#endif /*sequence.h*/
@@ -0,0 +1,374 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	simulator.c
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Implements a simulator of the VME-EVG-230/RF timing card, answering its UDP protocol
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "evg.h"
+#include "simulator.h"
+
+/*Macros*/
+#define SIMULATOR_COUNT			8		/*Maximum number of simulators*/
+#define SIMULATOR_REGISTERS		64		/*Number of 16-bit registers in the register map*/
+#define SIMULATOR_MESSAGES		64		/*Maximum number of messages in one datagram*/
+#define SIMULATOR_REPLIES		256		/*Maximum number of replies waiting for their latency to elapse*/
+
+/** @brief reply_t is a datagram held back until the latency of the link has elapsed */
+typedef struct
+{
+	uint64_t			due;							/*Time the reply is sent, in microseconds*/
+	uint32_t			length;							/*Length of the datagram in bytes*/
+	struct sockaddr_in	address;						/*Address of the requester*/
+	message_t			messages[SIMULATOR_MESSAGES];	/*Messages of the datagram*/
+} reply_t;
+
+/** @brief simulator_t emulates one VME-EVG230 on a UDP port of the loopback interface */
+typedef struct
+{
+	uint16_t		port;										/*UDP port, in host byte-order*/
+	int				socket;										/*Socket bound to the port*/
+	pthread_t		thread;										/*Thread serving the socket*/
+	pthread_mutex_t	mutex;										/*Mutex for accessing the link parameters*/
+	uint32_t		latency;									/*Delay of every reply in microseconds*/
+	uint32_t		jitter;										/*Largest random delay added to the latency in microseconds*/
+	double			loss;										/*Probability of losing a request, and of losing its reply*/
+	unsigned short	seed[3];									/*State of the random generator*/
+	uint16_t		registers[SIMULATOR_REGISTERS];				/*Register map, indexed by address / 2*/
+	uint16_t		ram[NUMBER_OF_SEQUENCERS][NUMBER_OF_ADDRESSES][3];	/*Sequencer RAM: code, high and low word of the timestamp*/
+	uint16_t		prescalers[NUMBER_OF_COUNTERS][2];			/*Counter prescalers: low and high word*/
+	reply_t			replies[SIMULATOR_REPLIES];					/*Replies waiting to be sent*/
+	uint32_t		replyCount;									/*Number of replies waiting to be sent*/
+} simulator_t;
+
+/*Function prototypes*/
+static	void*		serve		(void *arg);
+static	void		handle		(simulator_t *simulator, message_t *message);
+static	uint16_t*	target		(simulator_t *simulator, uint16_t reg);
+static	uint64_t	elapsed		(void);
+
+/*Local variables*/
+static	simulator_t		*simulators[SIMULATOR_COUNT];						/*Simulators started*/
+static	uint32_t		simulatorCount;										/*Number of simulators started*/
+static	pthread_mutex_t	simulatorMutex	=	PTHREAD_MUTEX_INITIALIZER;	/*Mutex for accessing the simulators*/
+
+/**
+ * @brief	Starts an EVG230 simulator, or changes the link parameters of a running one
+ *
+ * The simulator listens on 127.0.0.1:port and speaks the protocol of message_t: every message
+ * of a request datagram is carried out in order, and all replies go back in one datagram with
+ * their references echoed, so the driver sees a tagged device that supports batching.
+ * evgConfigure <name> 127.0.0.1 <port> <frequency> points a device at it.
+ *
+ * Each reply is held back by latency plus a random delay of up to jitter, replies may therefore
+ * come back out of order. Each request is lost with probability loss, and so is each reply.
+ *
+ * @param	port	:	UDP port of the simulator
+ * @param	latency	:	Delay of every reply in microseconds
+ * @param	jitter	:	Largest random delay added to the latency in microseconds
+ * @param	loss	:	Probability of losing a datagram, from 0 to 1
+ * @return	0 on success, -1 on failure
+ */
+long
+evg_simulate(uint16_t port, uint32_t latency, uint32_t jitter, double loss)
+{
+	int32_t				status;
+	uint32_t			i;
+	simulator_t			*simulator;
+	struct sockaddr_in	address;
+
+	/*Check inputs*/
+	if (!port)
+	{
+		printf("\x1B[31m[evg][simulate] Missing port\n\x1B[0m");
+		return -1;
+	}
+	if (loss < 0 || loss > 1)
+	{
+		printf("\x1B[31m[evg][simulate] Loss must be between 0 and 1\n\x1B[0m");
+		return -1;
+	}
+
+	pthread_mutex_lock(&simulatorMutex);
+
+	/*Change the link of a running simulator*/
+	for (i = 0; i < simulatorCount; i++)
+	{
+		if (simulators[i]->port == port)
+		{
+			pthread_mutex_lock(&simulators[i]->mutex);
+			simulators[i]->latency	=	latency;
+			simulators[i]->jitter	=	jitter;
+			simulators[i]->loss		=	loss;
+			pthread_mutex_unlock(&simulators[i]->mutex);
+			pthread_mutex_unlock(&simulatorMutex);
+			return 0;
+		}
+	}
+
+	if (simulatorCount >= SIMULATOR_COUNT)
+	{
+		printf("\x1B[31m[evg][simulate] More than %u simulators\n\x1B[0m", SIMULATOR_COUNT);
+		pthread_mutex_unlock(&simulatorMutex);
+		return -1;
+	}
+	simulator	=	calloc(1, sizeof(simulator_t));
+	if (!simulator)
+	{
+		printf("\x1B[31m[evg][simulate] Unable to allocate memory\n\x1B[0m");
+		pthread_mutex_unlock(&simulatorMutex);
+		return -1;
+	}
+	simulator->port										=	port;
+	simulator->latency									=	latency;
+	simulator->jitter									=	jitter;
+	simulator->loss										=	loss;
+	simulator->seed[0]									=	port;
+	simulator->registers[REGISTER_FIRMWARE / 2]			=	SIMULATOR_FIRMWARE;
+	simulator->registers[REGISTER_CONTROL / 2]			=	CONTROL_DISABLE;
+	simulator->registers[REGISTER_USEC_DIVIDER / 2]		=	USEC_DIVIDER;
+	pthread_mutex_init(&simulator->mutex, NULL);
+
+	/*Create and bind UDP socket*/
+	simulator->socket	=	socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (simulator->socket < 0)
+	{
+		printf("\x1B[31m[evg][simulate] Unable to create socket\n\x1B[0m");
+		free(simulator);
+		pthread_mutex_unlock(&simulatorMutex);
+		return -1;
+	}
+	memset((uint8_t *)&address, 0, sizeof(address));
+	address.sin_family		=	AF_INET;
+	address.sin_port		=	htons(port);
+	address.sin_addr.s_addr	=	htonl(INADDR_LOOPBACK);
+	status	=	bind(simulator->socket, (struct sockaddr*)&address, sizeof(address));
+	if (status < 0)
+	{
+		printf("\x1B[31m[evg][simulate] Unable to bind port %u\n\x1B[0m", port);
+		close(simulator->socket);
+		free(simulator);
+		pthread_mutex_unlock(&simulatorMutex);
+		return -1;
+	}
+
+	/*Start serving*/
+	status	=	pthread_create(&simulator->thread, NULL, serve, simulator);
+	if (status)
+	{
+		printf("\x1B[31m[evg][simulate] Unable to create simulator thread\n\x1B[0m");
+		close(simulator->socket);
+		free(simulator);
+		pthread_mutex_unlock(&simulatorMutex);
+		return -1;
+	}
+	simulators[simulatorCount++]	=	simulator;
+
+	pthread_mutex_unlock(&simulatorMutex);
+
+	return 0;
+}
+
+/**
+ * @brief	Serves the requests sent to a simulator
+ *
+ * Waits for a request or for the next reply to fall due, whichever comes first.
+ * Requests are carried out as soon as they arrive, only their replies are delayed.
+ *
+ * @param	*arg	:	A pointer to the simulator
+ * @return	Never returns
+ */
+static void*
+serve(void *arg)
+{
+	int32_t				status;
+	uint32_t			i;
+	uint32_t			next;
+	uint64_t			time;
+	uint32_t			latency;
+	uint32_t			jitter;
+	double				loss;
+	reply_t				*reply;
+	socklen_t			length;
+	fd_set				events;
+	struct timeval		timeout;
+	simulator_t			*simulator	=	(simulator_t*)arg;
+
+	for (;;)
+	{
+		/*Send the replies that fell due and find the next one*/
+		time	=	elapsed();
+		next	=	SIMULATOR_REPLIES;
+		for (i = 0; i < simulator->replyCount;)
+		{
+			reply	=	&simulator->replies[i];
+			if (reply->due <= time)
+			{
+				sendto(simulator->socket, reply->messages, reply->length, 0, (struct sockaddr*)&reply->address, sizeof(reply->address));
+				*reply	=	simulator->replies[--simulator->replyCount];
+				continue;
+			}
+			if (next == SIMULATOR_REPLIES || reply->due < simulator->replies[next].due)
+				next	=	i;
+			i++;
+		}
+
+		/*Wait for a request, or for the next reply*/
+		FD_ZERO(&events);
+		FD_SET(simulator->socket, &events);
+		if (next < simulator->replyCount)
+		{
+			timeout.tv_sec	=	(simulator->replies[next].due - time) / 1000000;
+			timeout.tv_usec	=	(simulator->replies[next].due - time) % 1000000;
+		}
+		status	=	select(simulator->socket + 1, &events, NULL, NULL, next < simulator->replyCount ? &timeout : NULL);
+		if (status <= 0)
+			continue;
+
+		/*Read the request into a reply slot, and drop it when the queue is full*/
+		if (simulator->replyCount >= SIMULATOR_REPLIES)
+		{
+			recv(simulator->socket, simulator->replies[0].messages, 0, 0);
+			continue;
+		}
+		reply	=	&simulator->replies[simulator->replyCount];
+		length	=	sizeof(reply->address);
+		status	=	recvfrom(simulator->socket, reply->messages, sizeof(reply->messages), 0, (struct sockaddr*)&reply->address, &length);
+		if (status < (int32_t)sizeof(message_t))
+			continue;
+		reply->length	=	status - status % sizeof(message_t);
+
+		pthread_mutex_lock(&simulator->mutex);
+		latency	=	simulator->latency;
+		jitter	=	simulator->jitter;
+		loss	=	simulator->loss;
+		pthread_mutex_unlock(&simulator->mutex);
+
+		/*Lose the request*/
+		if (erand48(simulator->seed) < loss)
+			continue;
+
+		for (i = 0; i < reply->length / sizeof(message_t); i++)
+			handle(simulator, &reply->messages[i]);
+
+		/*Lose the reply, or hold it back*/
+		if (erand48(simulator->seed) < loss)
+			continue;
+		reply->due	=	elapsed() + latency + (jitter ? (uint64_t)(erand48(simulator->seed) * (jitter + 1)) : 0);
+		simulator->replyCount++;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Carries out one message and turns it into its reply
+ *
+ * Writes to the control register clear the self-clearing sequencer trigger bits.
+ * Addresses outside of the register map read as 0 and ignore writes.
+ *
+ * @param	*simulator	:	A pointer to the simulator
+ * @param	*message	:	Message in network byte-order, replaced by its reply
+ */
+static void
+handle(simulator_t *simulator, message_t *message)
+{
+	uint32_t	address	=	ntohl(message->address);
+	uint16_t	*data	=	NULL;
+
+	if (address >= REGISTER_BASE_ADDRESS && address - REGISTER_BASE_ADDRESS < 2 * SIMULATOR_REGISTERS)
+		data	=	target(simulator, address - REGISTER_BASE_ADDRESS);
+
+	if (message->access == ACCESS_WRITE && data)
+	{
+		*data	=	ntohs(message->data);
+		if (address == REGISTER_BASE_ADDRESS + REGISTER_CONTROL)
+			*data	&=	~(CONTROL_VTRG1 | CONTROL_VTRG2);
+	}
+	else if (message->access == ACCESS_READ)
+		message->data	=	htons(data ? *data : 0);
+	message->status	=	0;
+}
+
+/**
+ * @brief	Maps a register to its storage
+ *
+ * The sequencer RAM is addressed through REGISTER_SEQ_ADDRESS0/1, the counter prescalers
+ * through the counter and the MXC_CONTROL_HIGH_WORD bit of REGISTER_MXC_CONTROL.
+ *
+ * @param	*simulator	:	A pointer to the simulator
+ * @param	reg			:	Address of register
+ * @return	Storage of the register
+ */
+static uint16_t*
+target(simulator_t *simulator, uint16_t reg)
+{
+	uint16_t	control	=	simulator->registers[REGISTER_MXC_CONTROL / 2];
+	uint16_t	slot0	=	simulator->registers[REGISTER_SEQ_ADDRESS0 / 2] % NUMBER_OF_ADDRESSES;
+	uint16_t	slot1	=	simulator->registers[REGISTER_SEQ_ADDRESS1 / 2] % NUMBER_OF_ADDRESSES;
+
+	switch (reg)
+	{
+		case REGISTER_SEQ_CODE0:
+			return &simulator->ram[0][slot0][0];
+		case REGISTER_SEQ_TIME0:
+			return &simulator->ram[0][slot0][1];
+		case REGISTER_SEQ_TIME0+2:
+			return &simulator->ram[0][slot0][2];
+		case REGISTER_SEQ_CODE1:
+			return &simulator->ram[1][slot1][0];
+		case REGISTER_SEQ_TIME1:
+			return &simulator->ram[1][slot1][1];
+		case REGISTER_SEQ_TIME1+2:
+			return &simulator->ram[1][slot1][2];
+		case REGISTER_MXC_PRESCALER:
+			return &simulator->prescalers[control % NUMBER_OF_COUNTERS][control & MXC_CONTROL_HIGH_WORD ? 1 : 0];
+		default:
+			return &simulator->registers[reg / 2];
+	}
+}
+
+/**
+ * @brief	Reads the monotonic clock
+ *
+ * @return	Time in microseconds
+ */
+static uint64_t
+elapsed(void)
+{
+	struct timespec	time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
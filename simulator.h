@@ -0,0 +1,36 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	simulator.h
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Header file for the simulator of the VME-EVG-230/RF timing card
+ */
+
+#ifndef __SIMULATOR_H__
+#define __SIMULATOR_H__
+
+#include <stdint.h>
+
+/*Macros*/
+#define SIMULATOR_FIRMWARE		0x0230	/*Firmware version reported by the simulator*/
+
+/*Function prototypes*/
+long	evg_simulate	(uint16_t port, uint32_t latency, uint32_t jitter, double loss);
+
+#endif /*simulator.h*/
@@ -0,0 +1,247 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 3.0 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) Abdallah Ismail <abdallah.ismail@sesame.org.jo>, 2015
+ */
+
+/*
+ * @file 	waveform.c
+ * @author	Abdallah Ismail (abdallah.ismail@sesame.org.jo)
+ * @date 	2026-10-14
+ * @brief	Implements epics device support layer for the VME-EVG-230/RF timing card
+ */
+
+/*Standard includes*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*EPICS includes*/
+#include <epicsExport.h>
+#include <devSup.h>
+#include <dbAccess.h>
+#include <recSup.h>
+#include <callback.h>
+#include <waveformRecord.h>
+
+/*Application includes*/
+#include "parse.h"
+#include "array.h"
+#include "evg.h"
+
+/*Function prototypes*/
+static	long	initRecord	(waveformRecord *record);
+static 	long	ioRecord	(waveformRecord *record);
+static	void	process		(void* arg);
+static	void	complete	(void* arg, long status);
+
+/*Function definitions*/
+
+/** 
+ * @brief 	Initializes the record
+ *
+ * This function is called by recordInit during IOC initialization.
+ * For each record of this type, this function attemps the following:
+ * 	Checks record parameters.
+ * 	Parses record parameters.
+ * 	Checks that the element type and count suit the command, see evg_initArray.
+ * 	Sets record's private structure.
+ *
+ * @param	record	:	Pointer to record being initialized.
+ * @return	0 on success, -1 on failure.
+ */
+static long 
+initRecord(waveformRecord *record)
+{
+	int32_t	status;
+	io_t*	private;
+
+	if (record->inp.type != INST_IO) 
+	{
+		printf("[evg][initRecord] Unable to initialize %s: Illegal io type\r\n", record->name);
+		return -1;
+	}
+
+	private	=	evg_allocate();
+	if (!private)
+	{
+		printf("[evg][initRecord] Unable to initialize %s: Unable to allocate memory\r\n", record->name);
+		return -1;
+	}
+
+	status	=	evg_parse(private, record->inp.value.instio.string);
+	if (status < 0)
+	{
+		printf("[evg][initRecord] Unable to initialize %s: Could not parse parameters\r\n", record->name);
+		return -1;
+	}
+
+	private->device	=	evg_open(private->name);	
+	if (private->device == NULL)
+	{
+		printf("[evg][initRecord] Unable to initalize %s: Could not open device\r\n", record->name);
+		return -1;
+	}
+
+	/*Check the array against the command and allocate the copy the worker transfers*/
+	status	=	evg_initArray(private, record->name, record->nelm, record->ftvl, ARRAY_READ | ARRAY_WRITE);
+	if (status < 0)
+		return -1;
+
+	private->request.function	=	process;
+	private->request.arg		=	record;
+	private->request.name		=	private->command;
+	private->request.complete	=	complete;
+
+	record->dpvt	=	private;
+
+	return 0;
+}
+
+/** 
+ * @brief 	Performs IO on the record.
+ *
+ * This function is called by record support to perform IO on the record
+ * This function attemps the following:
+ * 	Checks record parameters.
+ * 	Parses IO string
+ * 	Sets record's private structure
+ * 	Queues the request that performs asynchronous IO on the record
+ *
+ * @param	record	:	Pointer to record being initializes
+ * @return	0 on success, -1 on failure
+ */
+static long 
+ioRecord(waveformRecord *record)
+{
+	int32_t		status	=	0;
+	io_t*		private	=	(io_t*)record->dpvt;
+
+	if (!record)
+	{
+		printf("[evg][ioRecord] Unable to perform io on %s: Null record pointer\r\n", record->name);
+		return -1;
+	}
+    if (!private)
+    {
+        printf("[evg][ioRecord] Unable to perform io on %s: Null private structure pointer\r\n", record->name);
+        return -1;
+    }
+	if (!strlen(private->command))
+	{
+		printf("[evg][ioRecord] Unable to perform io on %s: Command is empty\r\n", record->name);
+		return -1;
+	}
+
+	/*
+	 * Start IO
+	 */
+
+	/*If this is the first pass then queue the request to the device worker, set PACT, and return*/
+	if(!record->pact)
+	{
+		private->status	=	0;
+
+		/*Hand the worker a copy of the array, record support holds the record lock*/
+		evg_takeArray(private, record->bptr, record->nord, record->ftvl);
+
+		status	=	evg_queue(private->device, &private->request);
+		if (status < 0)
+		{
+			printf("[evg][ioRecord] Unable to perform IO on %s: Unable to queue request\r\n", record->name);
+			return -1;
+		}
+		record->pact = true;
+		return 0;
+	}
+
+	/*
+	 * This is the second pass, complete the request and return
+	 */
+	if (private->status	< 0)
+	{
+		printf("[evg][ioRecord] Unable to perform IO on %s\r\n", record->name);
+		record->pact=	false;
+		return -1;
+	}
+
+	/*Give the array read by the worker to the record, record support holds the record lock again*/
+	evg_giveArray(private, record->bptr, &record->nord, record->ftvl);
+	record->pact	=	false;
+
+	return 0;
+}
+
+/** 
+ * @brief 	Performs asynchronousIO on the record
+ *
+ * This function is called by the device worker thread.
+ * This function attemps the following:
+ * 	Transfers the copy of the array, see evg_processArray
+ *
+ * @param	arg	:	Pointer to the record
+ */
+static void
+process(void* arg)
+{
+	long		status;
+	waveformRecord*	record	=	(waveformRecord*)arg;
+	io_t*		private	=	(io_t*)record->dpvt;
+
+	status	=	evg_processArray(private, record->name);
+	if (status < 0)
+		private->status	=	-1;
+}
+
+/** 
+ * @brief 	Completes asynchronous IO on the record
+ *
+ * This function is called by the device worker thread once the IO is carried out,
+ * together with the requests gathered with it.
+ *
+ * @param	arg		:	Pointer to the record
+ * @param	status	:	0 on success, -1 if the gathered IO failed
+ */
+static void
+complete(void* arg, long status)
+{
+	waveformRecord*	record	=	(waveformRecord*)arg;
+	io_t*		private	=	(io_t*)record->dpvt;
+
+	if (status < 0)
+		private->status	=	-1;
+
+	/*Process record*/
+	callbackRequestProcessCallback(&private->callback, priorityLow, record);
+}
+
+struct devsup {
+    long	  number;
+    DEVSUPFUN report;
+    DEVSUPFUN init;
+    DEVSUPFUN init_record;
+    DEVSUPFUN get_ioint_info;
+    DEVSUPFUN read_wf;
+} waveformevg =
+{
+    5,
+    NULL,
+    NULL,
+    initRecord,
+    NULL,
+    ioRecord
+};
+epicsExportAddress(dset, waveformevg);